@@ -0,0 +1,24 @@
+#ifndef FALLING_GAME_CONSOLE
+#define FALLING_GAME_CONSOLE
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Starts listening for commands on the serial console. Must be called after
+ * anything else that installs a driver on the console UART (the spectator
+ * and frame streams). Does nothing if CONSOLE_ENABLED is 0.
+ */
+void consoleInit();
+
+/*
+ * Takes whatever has arrived on the console without waiting, and runs the
+ * command once a whole line has arrived. Called by the game loop after the
+ * frame has been flipped, in the time left before the next tick.
+ *
+ * Commands that change a game (its speed, pausing, block limit and renderer)
+ * apply to all `count` games, so the players of a versus game stay even.
+ */
+void consolePoll(GameState* games, int count);
+
+#endif
@@ -20,14 +20,32 @@
 // at a different speed to the blocks
 #define PLAYER_VELOCITY_MULT 2
 
-// The width of each falling block
+// The width of the standard falling block
 #define BLOCK_WIDTH 15
 
-// The head of each falling block
+// The head of the standard falling block
 #define BLOCK_HEIGHT 10
 
-// The amount of time (us) before the game over screen returns to the main menu
-#define DEATH_SCREEN_DELAY 5.0e6
+// The sizes (pixels) a falling block may be spawned with; the first is the standard block. Each
+// size has its own shape (see sprite.c), and must be at most 32 pixels wide.
+#define BLOCK_SIZE_COUNT 4
+#define BLOCK_SIZE_WIDTHS {BLOCK_WIDTH, 10, 24, 12}
+#define BLOCK_SIZE_HEIGHTS {BLOCK_HEIGHT, 10, 8, 16}
+
+// The speeds a falling block may be spawned with, as a multiple (in quarters) of the game velocity
+#define BLOCK_SPEED_COUNT 3
+#define BLOCK_SPEED_QUARTERS {4, 3, 6}
+
+// The amount of time (ms) before the game over screen returns to the main menu
+#define DEATH_SCREEN_DELAY 5000
+
+// How long (ms) button presses are ignored after the game over screen appears, in case the
+// player hit a button trying to avoid a block moments before death
+#define DEATH_INPUT_DELAY 500
+
+// How long (ms) button presses are ignored after boot; the TTGO board seems to emit two button
+// presses on GPIO pin 0 without any user action
+#define BOOT_INPUT_DELAY 1000
 
 // Velocity is measured per second. The `dt` provided to the game logic will be used
 // to ensure smooth movement even if frames are skipped.
@@ -35,11 +53,204 @@
 #define STARTING_VELOCITY 25
 #define MAX_VELOCITY 100
 
+// Set to 1 to stream per-tick game state deltas to spectators over UART (see spectator.c)
+#define SPECTATOR_ENABLED 0
+
+// The UART the spectator stream is written to. UART0 is the USB serial port on the TTGO
+// board; the host decoder skips over any console text mixed in to the stream.
+#define SPECTATOR_UART_NUM 0
+
+// How often (in ticks) a full keyframe is sent so a spectator joining mid-game can sync up
+#define SPECTATOR_KEYFRAME_INTERVAL 90
+
+// The size (bytes) of the buffer holding encoded frames waiting to be written to the UART.
+// Frames that don't fit are dropped, and the next frame is sent as a keyframe.
+#define SPECTATOR_BUFFER_SIZE 2048
+
+// The width/height (pixels) of the square tiles the framebuffer is split in to when
+// looking for changes between frames. The display is at most 240 pixels on either side.
+#define TILE_SIZE 16
+#define MAX_DISPLAY_DIMENSION 240
+#define MAX_TILES (((MAX_DISPLAY_DIMENSION + TILE_SIZE - 1) / TILE_SIZE) * ((MAX_DISPLAY_DIMENSION + TILE_SIZE - 1) / TILE_SIZE))
+
+// Set to 1 to hash the framebuffer's tiles before each flip and skip the flip when none changed
+// (see tileflip.c), and how often (in frames) the changed tile statistics are printed
+#define TILE_FLIP_ENABLED 1
+#define TILE_FLIP_REPORT_INTERVAL (TARGET_FPS * 10)
+
+// Set to 1 to stream a compressed diff of every frame over UART before it's flipped,
+// for watching headless test rigs (see framestream.c and tools/framestream.py)
+#define FRAMESTREAM_ENABLED 0
+
+// The UART the frame stream is written to. Use a different UART to the spectator
+// stream if both are enabled, otherwise their frames will interleave.
+#define FRAMESTREAM_UART_NUM 0
+
+// The size (bytes) of the buffer holding encoded frames waiting to be written to the UART.
+// Tiles that don't fit in a frame are sent in a later frame instead.
+#define FRAMESTREAM_BUFFER_SIZE 16384
+
+// The amount of high scores kept in the persistent high score table
+#define HIGHSCORE_COUNT 5
+
+// After a new high score, how long (ms) the background writer waits for more before writing
+// the table to flash; lets several quick games share a single flash write.
+#define HIGHSCORE_WRITE_DELAY 2000
+
+// Set to 1 to record every game's inputs to the `replay` flash partition (see replay.c)
+#define REPLAY_ENABLED 1
+
+// The size (bytes) of the RAM ring buffer holding recorded events waiting to be written to flash.
+// If the background writer falls this far behind, the rest of the game isn't recorded.
+#define REPLAY_BUFFER_SIZE 8192
+
+// The amount of recent games kept in the replay index
+#define REPLAY_INDEX_SIZE 8
+
+// The amount of flash sectors (4KB, about a minute of play each) the replay writer keeps erased
+// between games; sectors are never erased during a game, so this bounds how long a recording can be
+#define REPLAY_ERASE_AHEAD 8
+
+// Set to 1 to print a hash of the simulation state after every tick of a game, for comparing runs of
+// the same seed and inputs (see statehash.c and tools/statehash.py)
+#define STATE_HASH_ENABLED 0
+
+// Set to 1 to scale the CPU frequency to the work each frame needs (see power.c). Requires
+// CONFIG_PM_ENABLE in sdkconfig.
+#define POWER_MANAGEMENT_ENABLED 1
+
+// The share (percent) of the frame budget that frame work may take at the lower render frequency
+// before switching to the higher one, and the share it must fall under (as predicted at the
+// lower frequency) before switching back down.
+#define POWER_RAISE_THRESHOLD 65
+#define POWER_LOWER_THRESHOLD 45
+
+// Set to 1 to put the board in to deep sleep, keeping the games in RTC memory, when both buttons
+// are held for SUSPEND_HOLD_TIME ms or no button is pressed (nor console command typed) for
+// SUSPEND_IDLE_TIME seconds. The right button wakes it, back in to the same game (see suspend.c).
+#define SUSPEND_ENABLED 1
+#define SUSPEND_HOLD_TIME 1500
+#define SUSPEND_IDLE_TIME 60
+
+// The GPIO pin driving the display's backlight; held off through deep sleep
+#define SUSPEND_BACKLIGHT_PIN 4
+
+// Where the game tick comes from. The ESP high resolution timer runs its callback in the esp_timer
+// task, behind any other timers; a hardware timer group interrupt signals the game task directly.
+#define GAME_TIMER_ESP_TIMER 0
+#define GAME_TIMER_HW_GROUP 1
+#define GAME_TIMER_SOURCE GAME_TIMER_HW_GROUP
+
+// How often (in ticks) the tick jitter statistics are printed
+#define TIMER_STATS_INTERVAL (TARGET_FPS * 10)
+
+// Set to 1 to measure the time, cycles and flash cache miss stalls of each part of the frame
+// (see profiler.c)
+#define PROFILER_ENABLED 0
+
+// How often (in frames) the profiler prints its report
+#define PROFILER_REPORT_INTERVAL (TARGET_FPS * 5)
+
+// How often (in frames) the hot path audit prints its report, and whether it should abort on the
+// first allocation or stdio call made in the game loop instead of counting it. The audit is only
+// built with -DHOT_PATH_AUDIT=ON (see hotaudit.c).
+#define HOT_AUDIT_REPORT_INTERVAL (TARGET_FPS * 10)
+#define HOT_AUDIT_ABORT 0
+
+// How often (in frames) the pixel write counters print their report, and whether to dump a heatmap
+// of a frame with every report. The counters are only built with -DPIXEL_STATS=ON (see pixelstats.c).
+#define PIXEL_STATS_REPORT_INTERVAL (TARGET_FPS * 5)
+#define PIXEL_STATS_HEATMAP 0
+
+// Set to 1 to accept commands (tunables, replay control, stats dumps) typed in to the serial
+// console (see console.c), and the longest command line accepted
+#define CONSOLE_ENABLED 1
+#define CONSOLE_LINE_LENGTH 64
+
+// Set to 1 to spawn blocks from the scripted patterns in patterns/waves.pat (see pattern.c and
+// tools/patternc.py); with 0, or if the patterns fail to load, blocks spawn at random
+#define SPAWN_PATTERNS_ENABLED 1
+
+// The most pattern instructions run per tick, which bounds the cost of a tick whatever the pattern
+#define PATTERN_STEPS_PER_TICK 16
+
+// How deeply `repeat` blocks may nest in a pattern
+#define PATTERN_MAX_DEPTH 4
+
+// The patterns are ordered by difficulty; the next one becomes available each time the score
+// rises by this much
+#define PATTERN_UNLOCK_SCORE 1000
+
+// Set to 1 to check every spawn leaves the player a way out (see escape.c); spawns that would
+// close every path are moved, or held back until it's safe
+#define ESCAPE_VALIDATION_ENABLED 1
+
+// The width (pixels) of the lanes the escape model splits the screen in to
+#define ESCAPE_LANE_WIDTH 5
+#define ESCAPE_MAX_LANES (MAX_DISPLAY_DIMENSION / ESCAPE_LANE_WIDTH)
+
+// The resolution (ms) of the game timer wheel (see timerwheel.c), the amount of slots in each
+// level of the wheel (a power of two) and the amount of levels. Delays longer than
+// TIMER_WHEEL_RESOLUTION * TIMER_WHEEL_SLOTS ^ TIMER_WHEEL_LEVELS (about 43 minutes) wait at the
+// top level until they're in range.
+#define TIMER_WHEEL_RESOLUTION 10
+#define TIMER_WHEEL_SLOTS 64
+#define TIMER_WHEEL_LEVELS 3
+
+// The most game timers that may be pending at once
+#define GAME_TIMER_COUNT 16
+
+// The speed the game runs at, as a percentage of real time (see gameclock.c)
+#define GAME_CLOCK_SCALE 100
+
+// The fastest the game may be set to run, as a percentage of real time (see the console's `speed` command)
+#define GAME_CLOCK_MAX_SCALE 1000
+
+// Set above 0 to play a game headlessly at boot, for up to this many seconds of game time, as fast
+// as the CPU allows (nothing is drawn) before starting the game as usual; for benchmarking
+#define HEADLESS_WARP_SECONDS 0
+
+// The most particles (death explosions, near miss sparks) alive at once in each game. This bounds
+// what effects cost a frame whatever happens; once it's full, the oldest particles make way for new ones.
+#define PARTICLE_COUNT 96
+
+// The size (pixels) of a particle's square, and how fast (pixels per second squared) particles fall
+#define PARTICLE_SIZE 2
+#define PARTICLE_GRAVITY 240
+
+// A block passing within this many pixels beside the player throws sparks
+#define NEAR_MISS_DISTANCE 4
+
+// Set to 1 for a split-screen two-player game; each player has a half of the (landscape) screen
+// and one button (a press turns them around), and each half's game runs on its own core
+#define VERSUS_MODE_ENABLED 0
+
+// The stack size (bytes) of the task running the second player's game in versus mode
+#define VERSUS_TASK_STACK 3584
+
+// Set to 1 to replace the normal game with the bullet-hell stress mode (see stress.c), which keeps
+// adding blocks until the game can no longer hold its frame rate
+#define STRESS_MODE_ENABLED 0
+
+// The most blocks the stress mode will have on screen at once
+#define STRESS_MAX_BLOCKS 4096
+
+// The stress mode spawn rate (blocks per second) at the start, and how much it rises each second
+#define STRESS_START_RATE 15
+#define STRESS_RATE_GROWTH 20
+
+// The stress mode prints where frame time goes each time the block count crosses a multiple of this
+#define STRESS_REPORT_STEP 256
+
 // Include the graphics library supplied by Martin Johnson for 159236
 // CAUTION: No include guards provided, must only be included from CORE/when ifndef FALLING_GAME_CORE
 #include "graphics.h"
 #include "fonts.h"
 
+// The bits the game task is notified with; a tick is due, and/or an input packet has been queued
+#define GAME_NOTIFY_TICK (1 << 0)
+#define GAME_NOTIFY_INPUT (1 << 1)
+
 // The type of the game_update packet being dispatched. Tick means a redraw due to the game timer, input means an input from the user on GPIO(0/35)
 typedef enum GamePacketType {PACKET_TICK, PACKET_INPUT} GamePacketType;
 
@@ -55,12 +266,148 @@ typedef enum GameStatePhase {PHASE_MENU, PHASE_DEATH, PHASE_GAME} GameStatePhase
 // The current direction of movement for the player
 typedef enum GameStateDirection {DIR_LEFT, DIR_RIGHT, DIR_NONE} GameStateDirection;
 
-typedef struct GameBlock {
+// How the blocks are drawn; as their sprites, or as plain filled bounding boxes (cheaper)
+typedef enum RenderBackend {RENDER_SPRITES, RENDER_BOXES, RENDER_BACKEND_COUNT} RenderBackend;
+
+// The falling blocks, stored as parallel arrays (one entry per block) rather than an array of
+// structs, so the per-tick movement is a single tight loop over contiguous memory.
+typedef struct GameBlocks {
+    // The top edge of each block, in 16.16 fixed point so slow blocks still move smoothly
+    int32_t y[MAX_BLOCKS];
+    int16_t x[MAX_BLOCKS];
+
+    // The fall speed (pixels per second); zero unless the block is on screen
+    int16_t velocity[MAX_BLOCKS];
+
+    uint8_t width[MAX_BLOCKS];
+    uint8_t height[MAX_BLOCKS];
+
+    // The size and speed the block was spawned with (index in to BLOCK_SIZE_WIDTHS/HEIGHTS
+    // and BLOCK_SPEED_QUARTERS)
+    uint8_t size[MAX_BLOCKS];
+    uint8_t speed[MAX_BLOCKS];
+
+    uint8_t enabled[MAX_BLOCKS];
+    uint8_t waiting_for_respawn[MAX_BLOCKS];
+
+    // Set once the block has thrown near miss sparks, so it only does so once per fall
+    uint8_t near_missed[MAX_BLOCKS];
+
+    // The falling blocks of each speed, in a ring in the order they were spawned (oldest first).
+    // Blocks of a speed all spawn with their bottom edge at the top of the screen and move by the
+    // same amount every tick, so the oldest always has the lowest bottom edge (see check_collisions).
+    uint8_t ring[BLOCK_SPEED_COUNT][MAX_BLOCKS];
+    uint8_t ring_head[BLOCK_SPEED_COUNT];
+    uint8_t ring_count[BLOCK_SPEED_COUNT];
+} GameBlocks;
+
+// The y position (whole pixels) of the block at the index provided
+#define BLOCK_Y(blocks, i) ((blocks)->y[i] >> 16)
+
+// The clock the game runs on (see gameclock.c); only moves when the game loop advances it
+typedef struct GameClock {
+    // The game time (us) since the clock was started
+    int64_t now;
+
+    // The speed of the clock as a percentage of real time, and the part of a
+    // game us carried over from the last advance
+    int scale;
+    int carry;
+
+    // Set while the clock is stopped
+    int paused;
+
+    // Set while time-warping; the game is ticked but not drawn
+    int headless;
+} GameClock;
+
+// A handle to a pending game timer (see timerwheel.h); 0 is never a valid timer
+typedef uint32_t GameTimer;
+
+// Called when a game timer fires, with the argument it was scheduled with
+typedef void (*GameTimerCallback)(void* arg);
+
+// A timer in the wheel; linked in to the list of the slot it's due in
+typedef struct TimerNode {
+    int16_t next;
+    int16_t prev;
+
+    // Bumped every time the node is freed, invalidating old handles
+    uint16_t generation;
+    uint8_t pending;
+
+    // The step the timer fires on
+    uint32_t expires;
+
+    GameTimerCallback callback;
+    void* arg;
+} TimerNode;
+
+// The game's timers (see timerwheel.c); a fixed pool of nodes, and the head of each slot's list
+typedef struct TimerWheel {
+    TimerNode nodes[GAME_TIMER_COUNT];
+    int16_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    int16_t free_nodes;
+
+    // The last step processed, and time (us) carried over towards the next
+    uint32_t now;
+    int carry;
+} TimerWheel;
+
+// The interpreter state of the spawn pattern currently running (see pattern.c)
+typedef struct PatternRunner {
+    // The pattern running (-1 for none), and the offset of its next instruction
+    int pattern;
+    int pc;
+
+    // The time (us) left before the next instruction runs
+    int32_t wait;
+
+    // The x position register used by `spawn_at`
     int x;
-    int y;
-    int enabled;
-    int waiting_for_respawn;
-} GameBlock;
+
+    // The open `repeat` blocks, innermost last; where each loops back to and how many runs are left
+    int depth;
+    int loop_start[PATTERN_MAX_DEPTH];
+    int loop_count[PATTERN_MAX_DEPTH];
+} PatternRunner;
+
+// When each lane of the screen will be blocked at the player's height, by the blocks already
+// spawned (see escape.c). Times are in ms of game time.
+typedef struct EscapeModel {
+    int32_t now;
+    int32_t carry_us;
+
+    // The earliest and latest time any block spawned in to each lane is level with the player
+    int32_t busy_from[ESCAPE_MAX_LANES];
+    int32_t busy_until[ESCAPE_MAX_LANES];
+} EscapeModel;
+
+// The particle effects that can be emitted (see particles.c)
+typedef enum ParticleEffect {EFFECT_EXPLOSION, EFFECT_SPARKS} ParticleEffect;
+
+// The live particles of a game (see particles.c); packed at the front of the arrays, oldest first
+typedef struct ParticlePool {
+    // Positions in 16.16 fixed point, relative to the game's field
+    int32_t x[PARTICLE_COUNT];
+    int32_t y[PARTICLE_COUNT];
+
+    // Velocities (pixels per second)
+    int16_t vx[PARTICLE_COUNT];
+    int16_t vy[PARTICLE_COUNT];
+
+    // The time (ms) each particle has left
+    int16_t life[PARTICLE_COUNT];
+    uint16_t colour[PARTICLE_COUNT];
+
+    int count;
+
+    // The part of a pixel per second of gravity (in millionths) carried over to the next tick
+    int gravity_carry;
+
+    // The effects' own random number generator, so effects never change how a game plays out
+    uint32_t rng;
+} ParticlePool;
 
 typedef struct Player {
     int x;
@@ -70,10 +417,31 @@ typedef struct Player {
 
 // The game state created when the game starts
 typedef struct GameState {
+    // Which game this is; 0, or 1 for the second player in versus mode. Only game 0 is recorded.
+    int instance;
+
+    // Set while re-running a recorded game (see statehash.c); it isn't entered in the high score table
+    int replaying;
+
+    // The part of the screen the game is played and drawn in; the whole width, or half of it in
+    // versus mode. Game positions are relative to the left edge.
+    int field_x;
+    int field_width;
+
     // General information about the game
     GameStatePhase phase;
     int velocity;
 
+    // The ticks played since the game started
+    uint32_t ticks;
+
+    // The game's own random number generator (xorshift32; see gameRandom), so games running
+    // side by side don't share a sequence
+    uint32_t rng;
+
+    // Game time; every tick is driven by this rather than the wall clock
+    GameClock clock;
+
     // The movement of the player
     GameStateDirection player_direction;
 
@@ -81,10 +449,36 @@ typedef struct GameState {
     int selection;
     
     // The blocks currently in the game
-    GameBlock blocks[MAX_BLOCKS];
+    GameBlocks blocks;
+
+    // The block spawned most recently (-1 if none); a new block isn't spawned until
+    // it has cleared the top of the screen
+    int last_spawned;
+
+    // The scripted spawn pattern being run
+    PatternRunner pattern;
+
+    // The model spawns are checked against, so the player always has a way out
+    EscapeModel escape;
+
     Player player;
 
-    // Used to automatically return to menu after game over
-    int64_t auto_advance_time;
+    // The explosion and spark particles currently alive
+    ParticlePool particles;
+
+    // The game's timers, and the one that automatically returns to menu after game over
+    TimerWheel timers;
+    GameTimer death_timer;
+
+    // Set while button presses should be ignored
+    int input_locked;
+
+    // The position the last game's score took in the high score table (-1 if it didn't place)
+    int highscore_rank;
+
+    // Tunables set from the console (see console.c); the most blocks in play (0 for no
+    // limit beyond the difficulty), and how blocks are drawn
+    int block_limit;
+    RenderBackend render_backend;
 } GameState;
 #endif
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef FALLING_GAME_ESCAPE
+#define FALLING_GAME_ESCAPE
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Clears the model; no lane is blocked.
+ */
+void escapeReset(EscapeModel* model);
+
+/*
+ * Advances the model's clock by a tick of `dt` ms.
+ */
+void escapeAdvance(EscapeModel* model, double dt);
+
+/*
+ * Checks a block about to be spawned at the x position provided (with the size and
+ * fall velocity provided) still leaves the player a lane they can reach in time.
+ * If not, the block is moved clear of the nearest lane that would otherwise have
+ * been safe.
+ *
+ * Returns the x position to spawn the block at, having recorded the block in
+ * the model, or -1 if it can't be spawned anywhere safe right now.
+ */
+int escapePlace(GameState* state, int x, int width, int height, int velocity);
+
+#endif
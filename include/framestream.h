@@ -0,0 +1,25 @@
+#ifndef FALLING_GAME_FRAMESTREAM
+#define FALLING_GAME_FRAMESTREAM
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Prepares the frame stream; installs the UART driver and starts the low
+ * priority task that drains encoded frames out to the UART.
+ *
+ * Does nothing if FRAMESTREAM_ENABLED is 0.
+ */
+void frameStreamInit();
+
+/*
+ * Encodes the tiles of the framebuffer that changed since the last frame was
+ * captured and queues them for transmission. Must be called after the frame has
+ * been drawn, but before it's flipped.
+ *
+ * Never blocks; tiles that don't fit in the transmit buffer are marked stale and
+ * sent with a later frame.
+ */
+void frameStreamCapture();
+
+#endif
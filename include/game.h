@@ -4,6 +4,20 @@
 // Pull in required structs, enums and constants
 #include "core.h"
 
+/*
+ * Prepares a freshly created game state (with its instance and field set);
+ * starts its game clock and timers, and ignores button presses for a moment
+ * after boot (see BOOT_INPUT_DELAY).
+ */
+void gameInit(GameState* state);
+
+/*
+ * Starts a game straight away, with its random number generator seeded with
+ * the seed provided, as if the player had pressed start; for re-running a
+ * recorded game.
+ */
+void gameStart(GameState* state, uint32_t seed);
+
 /*
  * Dispatches a TICK game update packet, this means we're being requested
  * to movement the game elements, calculate collisions, and redraw the
@@ -21,4 +35,40 @@ void handleTickPacket(GamePacket packet, GameState* state);
  */
 void handleInputPacket(GamePacket packet, GameState* state);
 
+/*
+ * Starts a block falling from the top of the screen at the x position provided, with
+ * the size (index in to BLOCK_SIZE_WIDTHS/HEIGHTS) and speed (index in to
+ * BLOCK_SPEED_QUARTERS) provided. A negative `x` picks a random position.
+ *
+ * Returns the index of the block used, or -1 if every block is already falling
+ * or the block would leave the player no way out (see escapePlace).
+ */
+int spawnBlock(GameState* state, int x, int size, int speed);
+
+/*
+ * Takes back the block most recently spawned at the speed provided, as if it had
+ * never fallen; for undoing a formation that couldn't be finished. The escape
+ * model isn't changed; restore a copy of it taken before the formation.
+ */
+void unspawnBlock(GameState* state, int speed);
+
+/*
+ * The next number (0 to INT_MAX) from the game's own random number generator,
+ * which is seeded afresh (and recorded) for every game.
+ */
+int gameRandom(GameState* state);
+
+/*
+ * Limits the amount of blocks in play to `limit` (0 removes the limit, leaving it
+ * to the difficulty). Blocks past the limit finish falling before they're removed.
+ * The limit is part of a game's recording (see replay.c), so it's replayed too.
+ */
+void setBlockLimit(GameState* state, int limit);
+
+/*
+ * Ends the game, showing the game over screen until the player presses a button
+ * or DEATH_SCREEN_DELAY passes.
+ */
+void showDeathScreen(GameState* state);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef FALLING_GAME_GAMECLOCK
+#define FALLING_GAME_GAMECLOCK
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Starts the clock provided at zero, running at GAME_CLOCK_SCALE.
+ */
+void gameClockStart(GameClock* clock);
+
+/*
+ * Advances the clock by `dt` us of real time, scaled by its speed.
+ *
+ * Returns the amount of game time (us) that passed; 0 while paused.
+ */
+int gameClockAdvance(GameClock* clock, int dt);
+
+/*
+ * The game time (us) since the clock was started.
+ */
+int64_t gameClockNow(const GameClock* clock);
+
+/*
+ * Stops or restarts the clock. Ticks still arrive while paused, but no game
+ * time passes so nothing moves and no game timers fire.
+ */
+void gameClockSetPaused(GameClock* clock, int paused);
+
+/*
+ * Sets the speed of the clock, as a percentage of real time (100 is real time,
+ * 200 double speed), from 0 to GAME_CLOCK_MAX_SCALE.
+ */
+void gameClockSetScale(GameClock* clock, int scale);
+
+/*
+ * Time-warps the game by up to `duration` ms of game time, ticking it in steps
+ * of one frame (as the tick timer would) without drawing or waiting in between.
+ * Stops early if the game moves to another phase (the player died, etc).
+ *
+ * Returns the amount of game time (ms) simulated.
+ */
+int gameClockWarp(GameState* state, int duration);
+
+#endif
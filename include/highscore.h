@@ -0,0 +1,32 @@
+#ifndef FALLING_GAME_HIGHSCORE
+#define FALLING_GAME_HIGHSCORE
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Initialises NVS, loads the high score table in to RAM and starts the low
+ * priority task that writes the table back to flash when it changes.
+ *
+ * Must be called once at boot, before any other highscore method.
+ */
+void highscoreInit();
+
+/*
+ * Offers a finished game's score to the high score table.
+ *
+ * The RAM copy of the table is updated immediately, and the background
+ * writer is woken to persist it; this never touches flash itself, so it's
+ * safe to call from the game loop.
+ *
+ * Returns the position the score took in the table, or -1 if it didn't place.
+ */
+int highscoreSubmit(int score);
+
+/*
+ * Returns the score at the position provided in the table (0 is the best), or
+ * 0 if there is no score at that position yet.
+ */
+int highscoreAt(int position);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef FALLING_GAME_HOTAUDIT
+#define FALLING_GAME_HOTAUDIT
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+// The parts of the game loop that must not allocate or touch stdio
+typedef enum HotAuditWindow {
+    AUDIT_TICK,
+    AUDIT_INPUT,
+    AUDIT_FLIP,
+    AUDIT_WINDOW_COUNT
+} HotAuditWindow;
+
+/*
+ * Marks the start/end of a hot window on the calling task. Every call to an
+ * allocator or stdio function the task makes in between is counted against
+ * the window, and the first call from each call site prints a backtrace.
+ *
+ * Only counts anything when the project is configured with -DHOT_PATH_AUDIT=ON
+ * (see src/CMakeLists.txt); otherwise these do nothing.
+ */
+void hotAuditEnter(HotAuditWindow window);
+void hotAuditExit();
+
+/*
+ * Marks the end of a frame. Every HOT_AUDIT_REPORT_INTERVAL frames the calls
+ * counted in each window, and the call sites they came from, are printed.
+ */
+void hotAuditFrameEnd();
+
+#endif
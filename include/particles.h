@@ -0,0 +1,37 @@
+#ifndef FALLING_GAME_PARTICLES
+#define FALLING_GAME_PARTICLES
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Kills every particle in the pool provided. Must be called before the pool is
+ * first used.
+ */
+void particlesReset(ParticlePool* pool);
+
+/*
+ * Emits the effect provided from (`x`, `y`), relative to the game's field. If the
+ * pool can't hold every new particle, the oldest particles are culled to make room.
+ */
+void particlesEmit(ParticlePool* pool, ParticleEffect effect, int x, int y);
+
+/*
+ * Moves every particle and kills those that have expired or fallen off the
+ * bottom of the screen. `dt` is in ms.
+ */
+void particlesTick(ParticlePool* pool, double dt);
+
+/*
+ * Draws the particles on screen rows `top` (inclusive) to `bottom` (exclusive)
+ * straight in to the framebuffer, clipped to the field provided. Drawing every
+ * row costs at most PARTICLE_COUNT * PARTICLE_SIZE ^ 2 pixel writes.
+ */
+void particlesDraw(const ParticlePool* pool, int field_x, int field_width, int top, int bottom);
+
+/*
+ * The amount of particles alive.
+ */
+int particlesActive(const ParticlePool* pool);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef FALLING_GAME_PATTERN
+#define FALLING_GAME_PATTERN
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Finds and checks the compiled spawn patterns embedded in the firmware
+ * (patterns/waves.pat, compiled by tools/patternc.py at build time). If they're
+ * missing or malformed, a warning is printed and patternTick never spawns.
+ */
+void patternInit();
+
+/*
+ * Stops any pattern running; the next tick starts a new one.
+ */
+void patternReset(PatternRunner* runner);
+
+/*
+ * Runs the spawn pattern for a tick of `dt` ms; at most PATTERN_STEPS_PER_TICK
+ * instructions are run. When a pattern ends, the next one is picked at random
+ * from those unlocked by the player's score.
+ *
+ * Returns 1 if the patterns are in charge of spawning, or 0 if none were loaded.
+ */
+int patternTick(GameState* state, double dt);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef FALLING_GAME_PIXELSTATS
+#define FALLING_GAME_PIXELSTATS
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Pixel write counters (see pixelstats.c). Only built when the project is
+ * configured with -DPIXEL_STATS=ON (see src/CMakeLists.txt); otherwise the
+ * counting calls compile to nothing, so they cost nothing in the hot path.
+ */
+#ifdef PIXEL_STATS
+/*
+ * Counts a write to every on-screen pixel of the rectangle provided, or to the
+ * single pixel provided. For code that writes to the framebuffer directly;
+ * calls to the graphics library are counted automatically.
+ */
+void pixelStatsRect(int x, int y, int width, int height);
+void pixelStatsPixel(int x, int y);
+
+/*
+ * Folds the frame just drawn in to the totals without flipping it, for frames
+ * whose flip is skipped (see tileflip.c). Flipped frames are folded in by the
+ * flip_frame wrapper.
+ */
+void pixelStatsFrameEnd();
+
+/*
+ * Dumps a heatmap of the writes to each pixel of the next frame finished to the
+ * console, for capture by tools/heatmap.py.
+ */
+void pixelStatsDumpHeatmap();
+#else
+#define pixelStatsRect(x, y, width, height)
+#define pixelStatsPixel(x, y)
+#define pixelStatsFrameEnd()
+#define pixelStatsDumpHeatmap()
+#endif
+
+#endif
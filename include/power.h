@@ -0,0 +1,27 @@
+#ifndef FALLING_GAME_POWER
+#define FALLING_GAME_POWER
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Enables dynamic frequency scaling; the CPU idles at 80MHz between frames and
+ * is only raised to the render frequency (160 or 240MHz) while a frame is being
+ * worked on.
+ *
+ * Does nothing if POWER_MANAGEMENT_ENABLED is 0.
+ */
+void powerInit();
+
+/*
+ * Marks the start/end of the work for a frame (game logic, rendering and
+ * flipping). The CPU is held at the render frequency in between.
+ *
+ * At the end of each frame the busy time is measured against the frame budget,
+ * and the render frequency lowered to 160MHz when there's plenty of headroom,
+ * or raised to 240MHz when there isn't.
+ */
+void powerFrameBegin();
+void powerFrameEnd();
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef FALLING_GAME_PROFILER
+#define FALLING_GAME_PROFILER
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+// The parts of a frame the profiler measures separately
+typedef enum ProfilerSection {
+    PROFILE_TICK,
+    PROFILE_COLLISIONS,
+    PROFILE_RENDER,
+    PROFILE_STREAMING,
+    PROFILE_FLIP,
+    PROFILE_SECTION_COUNT
+} ProfilerSection;
+
+/*
+ * Configures the Xtensa performance counters to count instruction fetch stalls
+ * caused by flash cache misses, and instructions executed.
+ *
+ * The counters belong to the core they're configured on, so this must be
+ * called from the task that runs the game loop. Does nothing if PROFILER_ENABLED is 0.
+ */
+void profilerInit();
+
+/*
+ * Marks the start/end of a frame. Every PROFILER_REPORT_INTERVAL frames the
+ * average time, cycles and cache miss stalls per frame are printed for each section.
+ */
+void profilerFrameBegin();
+void profilerFrameEnd();
+
+/*
+ * Marks the start/end of a section of the frame. Sections may be nested; time
+ * spent in a nested section is only counted against the nested section.
+ */
+void profilerBegin(ProfilerSection section);
+void profilerEnd(ProfilerSection section);
+
+/*
+ * Prints the averages per frame for every section since the last report, then
+ * resets the totals. Called automatically every PROFILER_REPORT_INTERVAL frames.
+ */
+void profilerReport();
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef FALLING_GAME_REPLAY
+#define FALLING_GAME_REPLAY
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+// A recent game found in the replay partition
+typedef struct ReplayIndexEntry {
+    uint32_t game_id;
+
+    // The sector holding the start of the game, and how many (consecutive) sectors it spans
+    int first_sector;
+    int chunks;
+
+    // The size of the recording in bytes, and the final score (-1 if the recording is incomplete)
+    int length;
+    int score;
+} ReplayIndexEntry;
+
+// The events of a recording, as passed to a ReplayEventCallback
+typedef enum ReplayEventType {REPLAY_TICK, REPLAY_INPUT, REPLAY_START, REPLAY_END, REPLAY_BLOCK_LIMIT} ReplayEventType;
+
+/*
+ * Called with each event of a recording read by replayRead; the value is the tick's dt (us),
+ * the input's direction, the game's seed, its final score or the block limit set from then on.
+ */
+typedef void (*ReplayEventCallback)(ReplayEventType type, uint32_t value, void* arg);
+
+/*
+ * Finds the replay partition, rebuilds the index of recent games from the
+ * sector headers and starts the background task that writes recordings to flash.
+ *
+ * Does nothing if REPLAY_ENABLED is 0 or there is no replay partition.
+ */
+void replayInit();
+
+/*
+ * Starts recording a new game. The seed provided must be the seed the game's
+ * random number generator was seeded with, and the block limit the one it
+ * starts with (see setBlockLimit), so the game can be replayed exactly.
+ */
+void replayBeginGame(uint32_t seed, int block_limit);
+
+/*
+ * Records a tick of the game, along with the delta time (us) it was run with.
+ */
+void replayRecordTick(int dt);
+
+/*
+ * Records an input (a GameStateDirection) that was applied to the game.
+ */
+void replayRecordInput(int direction);
+
+/*
+ * Records a change to the block limit (see setBlockLimit) part way through the game.
+ */
+void replayRecordBlockLimit(int block_limit);
+
+/*
+ * Finishes recording the current game, and has the background task flush the
+ * rest of it to flash.
+ */
+void replayEndGame(int score);
+
+/*
+ * Ends the game being recorded (if any) as an incomplete recording, and waits up
+ * to `timeout` ms for the background task to finish writing every recording to
+ * flash; for before the board sleeps.
+ *
+ * Returns 0 if the writer didn't finish in time.
+ */
+int replayFlush(int timeout);
+
+/*
+ * Starts or stops recording games. Recording starts with the next game, as a
+ * recording must begin with the game's seed; stopping part way through a game
+ * keeps what was recorded so far, as an incomplete recording.
+ */
+void replaySetEnabled(int enable);
+
+/*
+ * Copies the index of recent games (newest first) in to the array provided.
+ *
+ * Returns the amount of entries copied.
+ */
+int replayRecentGames(ReplayIndexEntry* entries, int max);
+
+/*
+ * Prints the recording of the recent game at the position provided (0 is the
+ * newest) to the console as hex, for capture by tools/replay.py.
+ */
+void replayDump(int position);
+
+/*
+ * Reads the recording of the recent game at the position provided (0 is the
+ * newest) from flash, calling the callback with each of its events in order.
+ *
+ * Returns 0 if there's no such game.
+ */
+int replayRead(int position, ReplayEventCallback callback, void* arg);
+
+#endif
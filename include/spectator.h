@@ -0,0 +1,25 @@
+#ifndef FALLING_GAME_SPECTATOR
+#define FALLING_GAME_SPECTATOR
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Prepares the spectator stream; installs the UART driver and starts the
+ * low priority task that drains encoded frames out to the UART.
+ *
+ * Does nothing if SPECTATOR_ENABLED is 0.
+ */
+void spectatorInit();
+
+/*
+ * Encodes the difference between the game state provided and the state
+ * sent in the previous frame, and queues it for transmission to any
+ * spectators. Every SPECTATOR_KEYFRAME_INTERVAL ticks (or after a frame
+ * had to be dropped) a full keyframe is sent instead.
+ *
+ * Never blocks; if the transmit buffer is full the frame is discarded.
+ */
+void spectatorEmit(const GameState* state);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef FALLING_GAME_SPRITE
+#define FALLING_GAME_SPRITE
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+// The tallest sprite; the player
+#define SPRITE_MAX_HEIGHT PLAYER_HEIGHT
+
+/*
+ * Draws a sprite of a fixed size with its top left pixel at `pixels`, `stride`
+ * pixels to a framebuffer row. Generated for each sprite by tools/gen_fill_kernels.py.
+ */
+typedef void (*SpriteKernel)(uint16_t* pixels, int stride, uint16_t colour);
+
+/*
+ * A 1-bit mask of the pixels a sprite covers. Each row is packed in to a word,
+ * the leftmost pixel in the most significant bit, so sprites are at most 32
+ * pixels wide.
+ */
+typedef struct SpriteMask {
+    int width;
+    int height;
+    uint32_t rows[SPRITE_MAX_HEIGHT];
+
+    // The unrolled kernels drawing the sprite's pixels and filling its bounding box
+    SpriteKernel blit;
+    SpriteKernel fill;
+} SpriteMask;
+
+/*
+ * Builds the masks of the player and of each block size from their pixel art.
+ */
+void spriteInit();
+
+/*
+ * The mask of the player, and of blocks of the size provided (index in to
+ * BLOCK_SIZE_WIDTHS/HEIGHTS).
+ */
+const SpriteMask* spritePlayer();
+const SpriteMask* spriteBlock(int size);
+
+/*
+ * Checks if sprite `a` at (ax, ay) and sprite `b` at (bx, by) have any pixels
+ * in common.
+ *
+ * Returns 1 if they are colliding, 0 otherwise.
+ */
+int spriteCollide(const SpriteMask* a, int ax, int ay, const SpriteMask* b, int bx, int by);
+
+/*
+ * Draws the pixels of the sprite provided straight in to the framebuffer,
+ * clipping any part that's off screen.
+ */
+void spriteDraw(const SpriteMask* sprite, int x, int y, uint16_t colour);
+
+/*
+ * As spriteDraw, but only draws the part of the sprite on screen rows `top`
+ * (inclusive) to `bottom` (exclusive); for drawing a frame in bands.
+ */
+void spriteDrawRows(const SpriteMask* sprite, int x, int y, uint16_t colour, int top, int bottom);
+
+/*
+ * Fills the bounding box of the sprite provided (see RENDER_BOXES), clipped to
+ * the screen and to rows `top` (inclusive) to `bottom` (exclusive).
+ */
+void spriteFillRows(const SpriteMask* sprite, int x, int y, uint16_t colour, int top, int bottom);
+
+#endif
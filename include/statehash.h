@@ -0,0 +1,34 @@
+#ifndef FALLING_GAME_STATEHASH
+#define FALLING_GAME_STATEHASH
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Marks the start of a game in the state hash stream, with the seed it was
+ * started with. Does nothing if STATE_HASH_ENABLED is 0, and for games other
+ * than the recorded one (or one being re-run).
+ */
+void stateHashBegin(const GameState* state, uint32_t seed);
+
+/*
+ * Prints the hash of each part of the simulation state after a tick of the game.
+ */
+void stateHashTick(const GameState* state);
+
+/*
+ * Marks the end of a game in the stream, with its final score. Called after the
+ * hash of the tick the game ended on.
+ */
+void stateHashEnd(const GameState* state);
+
+/*
+ * Re-runs the recorded game at the position provided (0 is the newest, see
+ * replayRead) headlessly, on a game of its own laid out like `like`, printing
+ * its state hashes for tools/statehash.py to compare with the original's.
+ *
+ * Returns 0 if there's no such recording.
+ */
+int stateHashReplay(int position, const GameState* like);
+
+#endif
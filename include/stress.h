@@ -0,0 +1,33 @@
+#ifndef FALLING_GAME_STRESS
+#define FALLING_GAME_STRESS
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Starts a stress mode run; clears the stress block pool and resets the
+ * spawn rate. Called in place of the normal block setup when
+ * STRESS_MODE_ENABLED is 1.
+ */
+void stressBegin(GameState* state);
+
+/*
+ * Spawns, moves and despawns the stress blocks, and checks them against the
+ * player. `dt` is in ms.
+ *
+ * Ends the run (moving to the death screen) once the game can no longer hold
+ * its frame rate; the score is then the most blocks it held at full rate.
+ */
+void stressTick(double dt, GameState* state);
+
+/*
+ * Draws every stress block straight in to the framebuffer.
+ */
+void stressRender(GameState* state);
+
+/*
+ * The amount of blocks currently in the stress pool.
+ */
+int stressBlockCount();
+
+#endif
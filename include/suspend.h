@@ -0,0 +1,55 @@
+#ifndef FALLING_GAME_SUSPEND
+#define FALLING_GAME_SUSPEND
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Checks whether this boot is a wake from suspension with the games still in
+ * RTC memory, and lets go of the display's backlight (held off through deep
+ * sleep). Must be called before graphics_init.
+ */
+void suspendInit();
+
+/*
+ * Copies the games kept in RTC memory over the `count` games provided, if this
+ * boot is a wake from suspension and they were suspended by this firmware, with
+ * the same amount of games.
+ *
+ * Returns 1 if the games were restored.
+ */
+int suspendRestore(GameState* games, int count);
+
+/*
+ * Marks a button press or release (or a console command), which puts off
+ * suspending for inactivity.
+ */
+void suspendActivity();
+
+/*
+ * Called once per pass of the game loop, with whether both buttons are down.
+ * Returns 1 once they've been held for SUSPEND_HOLD_TIME ms, or there's been no
+ * activity (see suspendActivity) for SUSPEND_IDLE_TIME seconds.
+ *
+ * Always 0 if SUSPEND_ENABLED is 0 (or in the stress mode, which keeps its
+ * blocks outside the game state).
+ */
+int suspendDue(int both_held);
+
+/*
+ * Shows the sleeping screen, waits for the buttons to be let go, then keeps the
+ * `count` games provided in RTC memory and puts the board in to deep sleep
+ * until the right button is pressed. Doesn't return.
+ *
+ * The game being recorded (see replay.c) is ended as an incomplete recording;
+ * the rest of a resumed game isn't recorded.
+ */
+void suspendNow(const GameState* games, int count);
+
+/*
+ * Called after each frame is flipped; after a resume, prints how long it took
+ * from the wake to the first frame of the restored game.
+ */
+void suspendFrameShown();
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef FALLING_GAME_TEXTFORMAT
+#define FALLING_GAME_TEXTFORMAT
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Copies `text` to `out`, and NUL terminates it.
+ *
+ * Returns a pointer to the terminator, so calls can be chained.
+ */
+char* formatText(char* out, const char* text);
+
+/*
+ * Writes `value` in decimal to `out`, zero padded to at least `min_digits`
+ * characters (like "%0*d"), and NUL terminates it.
+ *
+ * Returns a pointer to the terminator, so calls can be chained.
+ */
+char* formatInt(char* out, int value, int min_digits);
+
+#endif
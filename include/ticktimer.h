@@ -0,0 +1,48 @@
+#ifndef FALLING_GAME_TICKTIMER
+#define FALLING_GAME_TICKTIMER
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Configures and starts the game tick timer (see GAME_TIMER_SOURCE), targetting
+ * the TARGET_FPS defined in core.h.
+ *
+ * Every tick, the task provided is notified with GAME_NOTIFY_TICK.
+ */
+void tickTimerStart(TaskHandle_t game_task);
+
+/*
+ * Takes the time (us) that has passed over the ticks signalled since the last
+ * call. If the game task fell behind and missed a notification, the missed
+ * time is included rather than lost.
+ *
+ * Also records how long the game task took to respond to the tick, and prints
+ * the jitter statistics every TIMER_STATS_INTERVAL ticks.
+ */
+int tickTimerTakeDt();
+
+/*
+ * Throws away the time signalled since the last take, for after the game task
+ * has spent a while on something other than the game; the game would otherwise
+ * move by all of it in a single tick.
+ */
+void tickTimerSkip();
+
+/*
+ * Changes the tick rate to `fps` ticks per second, from the next tick on. The
+ * game moves by the dt of each tick, so only the smoothness changes; the rest
+ * of the firmware (power management, replays, etc) still assumes TARGET_FPS.
+ */
+void tickTimerSetFps(int fps);
+
+/*
+ * Prints the jitter and latency statistics, and the histogram of interval
+ * deviations, gathered since the last report, then resets them.
+ */
+void tickTimerReport();
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef FALLING_GAME_TILEFLIP
+#define FALLING_GAME_TILEFLIP
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Flips the frame to the display, unless no tile of it changed since the last
+ * frame flipped. Call in place of `flip_frame`; with TILE_FLIP_ENABLED at 0 it
+ * just calls `flip_frame`.
+ *
+ * Every TILE_FLIP_REPORT_INTERVAL frames, prints how many frames were skipped
+ * and how many tiles (and runs of tiles) changed per frame.
+ */
+void tileFlipFrame();
+
+/*
+ * Hands on a finished band of the frame (screen rows `top` to `bottom`) to be
+ * hashed straight away, rather than at the flip. Bands must be handed on top to
+ * bottom, start on a tile row, and not be drawn to again before the flip.
+ */
+void tileFlipBand(int top, int bottom);
+
+#endif
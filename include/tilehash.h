@@ -0,0 +1,35 @@
+#ifndef FALLING_GAME_TILEHASH
+#define FALLING_GAME_TILEHASH
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * The amount of tile columns/rows needed to cover the display at its current orientation.
+ */
+int tileColumns();
+int tileRows();
+
+/*
+ * Finds the pixel bounds of the tile at the index provided (row major). Tiles
+ * on the right/bottom edge may be smaller than TILE_SIZE.
+ */
+void tileBounds(int index, int* x, int* y, int* width, int* height);
+
+/*
+ * Hashes every tile of the framebuffer in to the array provided, which must
+ * have room for MAX_TILES hashes.
+ *
+ * The hash is a fast multiplicative hash, not a cryptographic one; it's only
+ * used to spot which tiles changed since the last frame without keeping a copy
+ * of that frame around.
+ */
+void tileHashFrame(uint32_t* hashes);
+
+/*
+ * As tileHashFrame, but only hashes the tiles in tile rows `first_row`
+ * (inclusive) to `end_row` (exclusive).
+ */
+void tileHashRows(uint32_t* hashes, int first_row, int end_row);
+
+#endif
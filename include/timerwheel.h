@@ -0,0 +1,44 @@
+#ifndef FALLING_GAME_TIMERWHEEL
+#define FALLING_GAME_TIMERWHEEL
+
+// Pull in required structs, enums and constants
+#include "core.h"
+
+/*
+ * Empties the wheel provided; every timer is freed and game time starts at
+ * zero. Must be called before the wheel is first used.
+ */
+void timerWheelReset(TimerWheel* wheel);
+
+/*
+ * Advances game time by `dt` us, firing every timer that falls due. Called
+ * once per tick, before the game is ticked.
+ */
+void timerWheelAdvance(TimerWheel* wheel, int dt);
+
+/*
+ * The game time (ms) since the wheel was reset.
+ */
+uint32_t timerWheelNow(const TimerWheel* wheel);
+
+/*
+ * Schedules the callback provided to be called with `arg` once `delay` ms of
+ * game time have passed (rounded up to TIMER_WHEEL_RESOLUTION). O(1).
+ *
+ * Returns a handle to the timer, or 0 (printing a warning) if GAME_TIMER_COUNT
+ * timers are already pending.
+ */
+GameTimer timerSchedule(TimerWheel* wheel, int delay, GameTimerCallback callback, void* arg);
+
+/*
+ * Cancels the timer provided if it's still pending. O(1). Handles to timers that
+ * have fired or been cancelled are ignored, so it's always safe to cancel.
+ */
+void timerCancel(TimerWheel* wheel, GameTimer timer);
+
+/*
+ * The time (ms) until the timer provided fires, or -1 if it isn't pending.
+ */
+int timerRemaining(const TimerWheel* wheel, GameTimer timer);
+
+#endif
@@ -0,0 +1,260 @@
+/*
+ * Serial console; tune the game and grab stats while it runs, rather than
+ * rebuilding and reflashing. Type `help` in to the monitor for the commands.
+ *
+ * The game loop polls the console once the frame has been flipped. Polling
+ * only copies the bytes waiting in the UART driver's buffer, without blocking;
+ * a command is only parsed and run once its whole line has arrived, so a frame
+ * never pays for more than a short copy unless a command is actually run.
+ */
+#include <driver/uart.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "console.h"
+#include "game.h"
+#include "gameclock.h"
+#include "ticktimer.h"
+#include "profiler.h"
+#include "replay.h"
+#include "pixelstats.h"
+#include "statehash.h"
+#include "suspend.h"
+
+#define CONSOLE_UART_NUM CONFIG_ESP_CONSOLE_UART_NUM
+#define MAX_ARGS 4
+
+typedef struct ConsoleCommand {
+    const char* name;
+    const char* usage;
+    void (*run)(GameState* games, int count, int argc, char** argv);
+} ConsoleCommand;
+
+/* Forward declaration of static methods */
+
+/*
+ * Splits the line provided in to words, and runs the command named by the first.
+ */
+static void run_line(GameState* games, int count, char* line);
+
+/*
+ * The commands; `argv[0]` is the command name. Commands that tune the game apply
+ * to all `count` games, so both halves of a versus game stay alike.
+ */
+static void command_help(GameState* games, int count, int argc, char** argv);
+static void command_fps(GameState* games, int count, int argc, char** argv);
+static void command_blocks(GameState* games, int count, int argc, char** argv);
+static void command_backend(GameState* games, int count, int argc, char** argv);
+static void command_pause(GameState* games, int count, int argc, char** argv);
+static void command_speed(GameState* games, int count, int argc, char** argv);
+static void command_replay(GameState* games, int count, int argc, char** argv);
+static void command_profile(GameState* games, int count, int argc, char** argv);
+static void command_timer(GameState* games, int count, int argc, char** argv);
+static void command_heatmap(GameState* games, int count, int argc, char** argv);
+
+static const ConsoleCommand commands[] = {
+    {"help", "", command_help},
+    {"fps", "<ticks per second>", command_fps},
+    {"blocks", "<most blocks in play, 0 for no limit>", command_blocks},
+    {"backend", "sprites|boxes", command_backend},
+    {"pause", "on|off", command_pause},
+    {"speed", "<percent of real time>", command_speed},
+    {"replay", "start|stop|list|dump <n>|verify <n>", command_replay},
+    {"profile", "(print the profiler report now)", command_profile},
+    {"timer", "(print the tick jitter stats and histogram now)", command_timer},
+    {"heatmap", "(dump an overdraw heatmap of the next frame)", command_heatmap}
+};
+
+#define COMMAND_COUNT (sizeof(commands) / sizeof(commands[0]))
+
+static const char* backend_names[RENDER_BACKEND_COUNT] = {"sprites", "boxes"};
+
+static int listening = 0;
+static char line[CONSOLE_LINE_LENGTH];
+static int line_length = 0;
+
+// Set when a line is too long; the rest of it is thrown away
+static int overflowed = 0;
+
+/* Method definitions */
+
+void consoleInit() {
+    if(!CONSOLE_ENABLED) return;
+
+    // The spectator or frame stream may already have a driver on this UART; it reads just as well
+    if(!uart_is_driver_installed(CONSOLE_UART_NUM)) {
+        uart_driver_install(CONSOLE_UART_NUM, 256, 0, 0, NULL, 0);
+    }
+
+    listening = 1;
+    printf("Console: type `help` for commands\n");
+}
+
+void consolePoll(GameState* games, int count) {
+    if(!listening) return;
+
+    uint8_t received[16];
+    int length;
+    while((length = uart_read_bytes(CONSOLE_UART_NUM, received, sizeof(received), 0)) > 0) {
+        for(int i = 0; i < length; i++) {
+            char c = received[i];
+            if(c == '\r' || c == '\n') {
+                if(overflowed) {
+                    printf("[CONSOLE] line too long, ignored\n");
+                } else if(line_length > 0) {
+                    line[line_length] = '\0';
+
+                    // Someone's using the console; don't suspend in the middle of their session
+                    suspendActivity();
+                    run_line(games, count, line);
+                }
+
+                line_length = 0;
+                overflowed = 0;
+            } else if(line_length < CONSOLE_LINE_LENGTH - 1) {
+                line[line_length++] = c;
+            } else {
+                overflowed = 1;
+            }
+        }
+    }
+}
+
+static void run_line(GameState* games, int count, char* text) {
+    char* argv[MAX_ARGS];
+    int argc = 0;
+    for(char* word = strtok(text, " \t"); word != NULL && argc < MAX_ARGS; word = strtok(NULL, " \t")) {
+        argv[argc++] = word;
+    }
+    if(argc == 0) return;
+
+    for(int i = 0; i < COMMAND_COUNT; i++) {
+        if(strcmp(argv[0], commands[i].name) == 0) {
+            commands[i].run(games, count, argc, argv);
+            return;
+        }
+    }
+
+    printf("[CONSOLE] unknown command `%s`, type `help` for commands\n", argv[0]);
+}
+
+static void command_help(GameState* games, int count, int argc, char** argv) {
+    for(int i = 0; i < COMMAND_COUNT; i++) {
+        printf("[CONSOLE] %-8s %s\n", commands[i].name, commands[i].usage);
+    }
+}
+
+static void command_fps(GameState* games, int count, int argc, char** argv) {
+    int fps = argc > 1 ? atoi(argv[1]) : 0;
+    if(fps < 1 || fps > 240) {
+        printf("[CONSOLE] usage: fps <1-240>\n");
+        return;
+    }
+
+    tickTimerSetFps(fps);
+    printf("[CONSOLE] ticking at %d FPS\n", fps);
+}
+
+static void command_blocks(GameState* games, int count, int argc, char** argv) {
+    if(argc < 2) {
+        printf("[CONSOLE] usage: blocks <0-%d>\n", MAX_BLOCKS);
+        return;
+    }
+
+    for(int i = 0; i < count; i++) setBlockLimit(&games[i], atoi(argv[1]));
+    if(games[0].block_limit > 0) {
+        printf("[CONSOLE] at most %d blocks in play\n", games[0].block_limit);
+    } else {
+        printf("[CONSOLE] block count left to the difficulty\n");
+    }
+}
+
+static void command_backend(GameState* games, int count, int argc, char** argv) {
+    for(int i = 0; argc > 1 && i < RENDER_BACKEND_COUNT; i++) {
+        if(strcmp(argv[1], backend_names[i]) == 0) {
+            for(int game = 0; game < count; game++) games[game].render_backend = i;
+            printf("[CONSOLE] drawing blocks as %s\n", backend_names[i]);
+            return;
+        }
+    }
+
+    printf("[CONSOLE] usage: backend sprites|boxes (currently %s)\n", backend_names[games[0].render_backend]);
+}
+
+static void command_pause(GameState* games, int count, int argc, char** argv) {
+    int paused = argc < 2 || strcmp(argv[1], "off") != 0;
+    for(int i = 0; i < count; i++) gameClockSetPaused(&games[i].clock, paused);
+    printf("[CONSOLE] game clock %s\n", paused ? "paused" : "running");
+}
+
+static void command_speed(GameState* games, int count, int argc, char** argv) {
+    int speed = argc > 1 ? atoi(argv[1]) : -1;
+    if(speed < 0 || speed > GAME_CLOCK_MAX_SCALE) {
+        printf("[CONSOLE] usage: speed <0-%d> (currently %d%%)\n", GAME_CLOCK_MAX_SCALE, games[0].clock.scale);
+        return;
+    }
+
+    for(int i = 0; i < count; i++) gameClockSetScale(&games[i].clock, speed);
+    printf("[CONSOLE] game running at %d%% of real time\n", games[0].clock.scale);
+}
+
+static void command_replay(GameState* games, int count, int argc, char** argv) {
+    const char* action = argc > 1 ? argv[1] : "";
+    if(strcmp(action, "start") == 0) {
+        replaySetEnabled(1);
+        printf("[CONSOLE] recording games from the next game on\n");
+    } else if(strcmp(action, "stop") == 0) {
+        replaySetEnabled(0);
+        printf("[CONSOLE] recording stopped\n");
+    } else if(strcmp(action, "list") == 0) {
+        ReplayIndexEntry entries[REPLAY_INDEX_SIZE];
+        int recorded = replayRecentGames(entries, REPLAY_INDEX_SIZE);
+        for(int i = 0; i < recorded; i++) {
+            printf("[CONSOLE] %d: game #%u, %d bytes, score %d\n", i, entries[i].game_id, entries[i].length, entries[i].score);
+        }
+        if(recorded == 0) printf("[CONSOLE] no recorded games\n");
+    } else if(strcmp(action, "dump") == 0 && argc > 2) {
+        replayDump(atoi(argv[2]));
+    } else if(strcmp(action, "verify") == 0 && argc > 2) {
+        if(!STATE_HASH_ENABLED) {
+            printf("[CONSOLE] state hashes are off (see STATE_HASH_ENABLED)\n");
+        } else {
+            // The re-run takes as long as printing its hashes does (seconds, for a long game); the live
+            // games stand still meanwhile, rather than jumping ahead by all of it afterwards
+            int paused[count];
+            for(int i = 0; i < count; i++) {
+                paused[i] = games[i].clock.paused;
+                gameClockSetPaused(&games[i].clock, 1);
+            }
+
+            if(!stateHashReplay(atoi(argv[2]), &games[0])) printf("[CONSOLE] no recorded game %s\n", argv[2]);
+
+            for(int i = 0; i < count; i++) gameClockSetPaused(&games[i].clock, paused[i]);
+            tickTimerSkip();
+        }
+    } else {
+        printf("[CONSOLE] usage: replay start|stop|list|dump <n>|verify <n>\n");
+    }
+}
+
+static void command_profile(GameState* games, int count, int argc, char** argv) {
+    if(!PROFILER_ENABLED) {
+        printf("[CONSOLE] the profiler is off (see PROFILER_ENABLED)\n");
+        return;
+    }
+
+    profilerReport();
+}
+
+static void command_timer(GameState* games, int count, int argc, char** argv) {
+    tickTimerReport();
+}
+
+static void command_heatmap(GameState* games, int count, int argc, char** argv) {
+#ifdef PIXEL_STATS
+    pixelStatsDumpHeatmap();
+#else
+    printf("[CONSOLE] pixel stats aren't built in (configure with -DPIXEL_STATS=ON)\n");
+#endif
+}
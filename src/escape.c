@@ -0,0 +1,178 @@
+/*
+ * Escape path validator; makes sure a spawn never closes off every way out
+ * for the player.
+ *
+ * The screen is split in to narrow lanes. For each lane the model keeps the
+ * window of time during which blocks already spawned in to it will be level
+ * with the player (merged in to one window per lane, which errs on the side of
+ * calling a lane blocked). That makes each spawn a single pass over the lanes:
+ *
+ *     - a block spawned now at velocity v is level with the player from when
+ *       its bottom edge reaches the player's top, to when its top edge passes
+ *       the player's bottom,
+ *     - the player moves at velocity * PLAYER_VELOCITY_MULT, so they reach
+ *       the player-sized slot n lanes away after n * lane width / speed,
+ *     - sweeping out from the player in both directions, each slot must be
+ *       clear at the moment the player would cross it; the first slot the
+ *       player can reach before the new block arrives, and that stays clear
+ *       while the new block is level with the player, is a way out.
+ *
+ * If the new block would leave no way out, it's moved to sit just beside the
+ * way out nearest the player (found without the new block), and checked again.
+ * Blocks change speed slightly as the game speeds up after being recorded,
+ * which the model ignores; the merged windows leave enough slack to cover it.
+ */
+#include <stddef.h>
+
+#include "escape.h"
+
+// The amount of lanes the player covers when lined up with them
+#define SLOT_LANES ((PLAYER_WIDTH + ESCAPE_LANE_WIDTH - 1) / ESCAPE_LANE_WIDTH)
+
+// The time window (and lanes) a block will be level with the player
+typedef struct BlockWindow {
+    int first_lane;
+    int last_lane;
+    int32_t from;
+    int32_t until;
+} BlockWindow;
+
+/* Forward declaration of static methods */
+
+/*
+ * Works out when, and in which lanes, a block spawned now will be level with the player.
+ */
+static BlockWindow block_window(const GameState* state, int x, int width, int height, int velocity);
+
+/*
+ * Returns 1 if any lane of the slot starting at the lane provided is blocked at any
+ * point between `from` and `until`, by the model or the extra block (if not NULL).
+ */
+static int slot_blocked(const EscapeModel* model, int slot, int32_t from, int32_t until, const BlockWindow* extra);
+
+/*
+ * Finds the way out nearest the player from the window of the block provided,
+ * also counting the extra block (if not NULL).
+ *
+ * Returns the first lane of the slot, or -1 if there is no way out.
+ */
+static int find_escape(const GameState* state, const BlockWindow* window, const BlockWindow* extra);
+
+/*
+ * Adds a block's window to the lanes it covers.
+ */
+static void record(EscapeModel* model, const BlockWindow* window);
+
+/* Method definitions */
+
+void escapeReset(EscapeModel* model) {
+    *model = (EscapeModel) {0};
+}
+
+void escapeAdvance(EscapeModel* model, double dt) {
+    model->carry_us += dt * 1000;
+    model->now += model->carry_us / 1000;
+    model->carry_us %= 1000;
+}
+
+int escapePlace(GameState* state, int x, int width, int height, int velocity) {
+    BlockWindow window = block_window(state, x, width, height, velocity);
+    if(!ESCAPE_VALIDATION_ENABLED || find_escape(state, &window, &window) >= 0) {
+        record(&state->escape, &window);
+        return x;
+    }
+
+    // If the player is already trapped this block doesn't make it any worse
+    int escape = find_escape(state, &window, NULL);
+    if(escape < 0) {
+        record(&state->escape, &window);
+        return x;
+    }
+
+    // Try just right of the way out, then just left of it
+    int candidates[2] = {(escape + SLOT_LANES) * ESCAPE_LANE_WIDTH, escape * ESCAPE_LANE_WIDTH - width};
+    for(int i = 0; i < 2; i++) {
+        int moved = candidates[i];
+        if(moved < 0 || moved + width > state->field_width) continue;
+
+        window = block_window(state, moved, width, height, velocity);
+        if(find_escape(state, &window, &window) >= 0) {
+            record(&state->escape, &window);
+            return moved;
+        }
+    }
+
+    return -1;
+}
+
+static BlockWindow block_window(const GameState* state, int x, int width, int height, int velocity) {
+    const Player* p = &state->player;
+    if(velocity < 1) velocity = 1;
+
+    // Blocks spawn with their bottom edge at the top of the screen
+    return (BlockWindow) {
+        .first_lane = x / ESCAPE_LANE_WIDTH,
+        .last_lane = (x + width - 1) / ESCAPE_LANE_WIDTH,
+        .from = state->escape.now + p->y * 1000 / velocity,
+        .until = state->escape.now + (p->y + PLAYER_HEIGHT + height) * 1000 / velocity
+    };
+}
+
+static int slot_blocked(const EscapeModel* model, int slot, int32_t from, int32_t until, const BlockWindow* extra) {
+    int blocked = 0;
+    for(int lane = slot; lane < slot + SLOT_LANES; lane++) {
+        blocked |= model->busy_until[lane] > from && model->busy_from[lane] < until;
+    }
+
+    if(extra != NULL && extra->first_lane < slot + SLOT_LANES && extra->last_lane >= slot) {
+        blocked |= extra->until > from && extra->from < until;
+    }
+
+    return blocked;
+}
+
+static int find_escape(const GameState* state, const BlockWindow* window, const BlockWindow* extra) {
+    const EscapeModel* model = &state->escape;
+    int slots = state->field_width / ESCAPE_LANE_WIDTH - SLOT_LANES + 1;
+
+    int start = (state->player.x + ESCAPE_LANE_WIDTH / 2) / ESCAPE_LANE_WIDTH;
+    if(start >= slots) start = slots - 1;
+
+    // The time (ms) the player takes to move one lane
+    int speed = state->velocity * PLAYER_VELOCITY_MULT;
+    int32_t lane_time = ESCAPE_LANE_WIDTH * 1000 / (speed > 0 ? speed : 1);
+
+    int best = -1;
+    int best_distance = 0;
+    for(int direction = -1; direction <= 1; direction += 2) {
+        for(int slot = start, distance = 0; slot >= 0 && slot < slots; slot += direction, distance++) {
+            if(best >= 0 && distance >= best_distance) break;
+
+            // The player gets here after moving `distance` lanes, which must be before the block
+            // arrives, and must be able to pass through
+            int32_t arrive = model->now + distance * lane_time;
+            if(arrive > window->from || slot_blocked(model, slot, arrive, arrive + lane_time, extra)) break;
+
+            if(!slot_blocked(model, slot, window->from, window->until, extra)) {
+                best = slot;
+                best_distance = distance;
+                break;
+            }
+        }
+    }
+
+    return best;
+}
+
+static void record(EscapeModel* model, const BlockWindow* window) {
+    for(int lane = window->first_lane; lane <= window->last_lane; lane++) {
+        if(model->busy_until[lane] <= model->now) {
+            // The lane's last window has passed; start a new one
+            model->busy_from[lane] = window->from;
+            model->busy_until[lane] = window->until;
+        } else {
+            if(window->from < model->busy_from[lane]) model->busy_from[lane] = window->from;
+            if(window->until > model->busy_until[lane]) model->busy_until[lane] = window->until;
+        }
+    }
+}
@@ -0,0 +1,281 @@
+/*
+ * Frame stream; sends a compressed diff of the framebuffer over UART each frame so
+ * a headless test rig can be watched remotely (see tools/framestream.py).
+ *
+ * Comparing whole frames would need a second 64KB framebuffer and far too much
+ * time, so instead each 16x16 tile is hashed and compared to the hash of the tile
+ * last sent. Only tiles whose hash changed are run-length encoded and sent.
+ *
+ * Frame layout on the wire:
+ *     0xA5 0xC3 | body length (4 bytes) | body | Fletcher-16 of body (2 bytes)
+ *
+ * Body (all values little endian):
+ *     frame number (4), width (2), height (2), tile size (1),
+ *     bitmap of tiles included (1 bit per tile, row major),
+ *     RLE pixels of each included tile, in order
+ *
+ * RLE: a control byte with the top bit set is a run of (low 7 bits + 1) copies
+ * of the pixel that follows. Otherwise it's (value + 1) literal pixels.
+ */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/stream_buffer.h>
+#include <driver/uart.h>
+#include <esp_timer.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "framestream.h"
+#include "tilehash.h"
+
+#define SYNC_BYTE_0 0xA5
+#define SYNC_BYTE_1 0xC3
+
+// Sync (2) + length (4) before the body, checksum (2) after it
+#define FRAME_HEADER 6
+#define FRAME_TRAILER 2
+
+// Frame number (4), width (2), height (2), tile size (1)
+#define BODY_HEADER 9
+
+// More than a single tile can take to encode (all literals is just over two bytes a pixel)
+#define MAX_ENCODED_TILE (TILE_SIZE * TILE_SIZE * 3)
+
+// How often (in frames) the encoder timing is printed
+#define STATS_INTERVAL (TARGET_FPS * 5)
+
+/* Forward declaration of static methods */
+
+/*
+ * The body of the low priority task that drains the stream buffer in to the UART.
+ */
+static void framestream_task(void* arg);
+
+/*
+ * Run-length encodes the tile at the index provided in to the buffer provided.
+ *
+ * Returns the amount of bytes written.
+ */
+static int encode_tile(int index, uint8_t* out);
+
+/*
+ * Writes a run of `count` copies of `pixel`, or `count` literal pixels. Both
+ * return the amount of bytes written.
+ */
+static int write_run(uint8_t* out, int count, uint16_t pixel);
+static int write_literal(uint8_t* out, const uint16_t* literal, int count);
+
+/*
+ * Fletcher-16 of the buffer provided; lets the decoder reject corrupt frames.
+ */
+static uint16_t fletcher16(const uint8_t* data, int length);
+
+static void put_u16(uint8_t* out, uint16_t value);
+static void put_u32(uint8_t* out, uint32_t value);
+
+// Encoded frames waiting to be sent to the UART by the framestream task
+static StreamBufferHandle_t pending_frames;
+
+// The frame currently being encoded
+static uint8_t encoded[FRAMESTREAM_BUFFER_SIZE / 2];
+
+// The hashes of the tiles in the current frame, and of the tiles as last sent
+static uint32_t current_hashes[MAX_TILES];
+static uint32_t sent_hashes[MAX_TILES];
+
+// Tiles which must be sent regardless of their hash; either never sent, or
+// dropped from an earlier frame.
+static uint8_t stale[MAX_TILES];
+
+static uint32_t frame_number = 0;
+
+// Encoder timing, reset every STATS_INTERVAL frames
+static int64_t encode_time_total = 0;
+static int64_t encode_time_max = 0;
+static uint32_t bytes_total = 0;
+
+/* Method definitions */
+
+void frameStreamInit() {
+    if(!FRAMESTREAM_ENABLED) return;
+
+    uart_driver_install(FRAMESTREAM_UART_NUM, 256, FRAMESTREAM_BUFFER_SIZE / 4, 0, NULL, 0);
+
+    pending_frames = xStreamBufferCreate(FRAMESTREAM_BUFFER_SIZE, 1);
+    xTaskCreate(framestream_task, "Framestream", 2048, NULL, tskIDLE_PRIORITY + 1, NULL);
+
+    // Nothing has been sent yet, so every tile must go in the first frame
+    memset(stale, 1, sizeof(stale));
+}
+
+void frameStreamCapture() {
+    if(!FRAMESTREAM_ENABLED) return;
+
+    int64_t start = esp_timer_get_time();
+    frame_number++;
+
+    int tiles = tileColumns() * tileRows();
+    tileHashFrame(current_hashes);
+
+    uint8_t* body = encoded + FRAME_HEADER;
+    uint8_t* bitmap = body + BODY_HEADER;
+    int bitmap_bytes = (tiles + 7) / 8;
+    memset(bitmap, 0, bitmap_bytes);
+
+    // Leave room for the trailer when deciding whether a tile fits
+    int capacity = sizeof(encoded) - FRAME_TRAILER;
+    int position = FRAME_HEADER + BODY_HEADER + bitmap_bytes;
+    int included = 0;
+    for(int i = 0; i < tiles; i++) {
+        // Early out; the tile is unchanged since we last sent it
+        if(!stale[i] && current_hashes[i] == sent_hashes[i]) continue;
+
+        if(position + MAX_ENCODED_TILE > capacity) {
+            // No more room this frame; send it next time
+            stale[i] = 1;
+            continue;
+        }
+
+        position += encode_tile(i, encoded + position);
+        bitmap[i >> 3] |= 1 << (i & 7);
+        included++;
+    }
+
+    if(included > 0) {
+        int body_length = position - FRAME_HEADER;
+        encoded[0] = SYNC_BYTE_0;
+        encoded[1] = SYNC_BYTE_1;
+        put_u32(encoded + 2, body_length);
+        put_u32(body, frame_number);
+        put_u16(body + 4, display_width);
+        put_u16(body + 6, display_height);
+        body[8] = TILE_SIZE;
+        put_u16(encoded + position, fletcher16(body, body_length));
+        position += FRAME_TRAILER;
+
+        // Only tiles that were actually queued count as sent; if the whole frame
+        // doesn't fit, the included tiles are all sent again next frame.
+        int queued = xStreamBufferSpacesAvailable(pending_frames) >= position;
+        if(queued) {
+            xStreamBufferSend(pending_frames, encoded, position, 0);
+            bytes_total += position;
+        }
+
+        for(int i = 0; i < tiles; i++) {
+            if(bitmap[i >> 3] & (1 << (i & 7))) {
+                sent_hashes[i] = current_hashes[i];
+                stale[i] = !queued;
+            }
+        }
+    }
+
+    int64_t elapsed = esp_timer_get_time() - start;
+    encode_time_total += elapsed;
+    if(elapsed > encode_time_max) encode_time_max = elapsed;
+
+    if(frame_number % STATS_INTERVAL == 0) {
+        printf("[FRAMESTREAM] encode avg %lldus max %lldus, %u bytes/frame\n",
+            encode_time_total / STATS_INTERVAL, encode_time_max, bytes_total / STATS_INTERVAL);
+
+        encode_time_total = 0;
+        encode_time_max = 0;
+        bytes_total = 0;
+    }
+}
+
+static void framestream_task(void* arg) {
+    uint8_t chunk[256];
+    while(1) {
+        size_t received = xStreamBufferReceive(pending_frames, chunk, sizeof(chunk), portMAX_DELAY);
+        if(received > 0) {
+            uart_write_bytes(FRAMESTREAM_UART_NUM, (const char*)chunk, received);
+        }
+    }
+}
+
+static int encode_tile(int index, uint8_t* out) {
+    int x, y, width, height;
+    tileBounds(index, &x, &y, &width, &height);
+
+    // Runs continue across rows of the tile; the decoder fills the tile row by row
+    uint16_t pixels[TILE_SIZE * TILE_SIZE];
+    int count = 0;
+    for(int row = y; row < y + height; row++) {
+        memcpy(pixels + count, frame_buffer + row * display_width + x, width * sizeof(uint16_t));
+        count += width;
+    }
+
+    int written = 0;
+    int literal_start = 0;
+    int i = 0;
+    while(i < count) {
+        int run = 1;
+        while(i + run < count && run < 128 && pixels[i + run] == pixels[i]) run++;
+
+        // Runs of two aren't worth breaking a literal for
+        if(run < 3) {
+            i += run;
+            continue;
+        }
+
+        written += write_literal(out + written, pixels + literal_start, i - literal_start);
+        written += write_run(out + written, run, pixels[i]);
+        i += run;
+        literal_start = i;
+    }
+
+    written += write_literal(out + written, pixels + literal_start, count - literal_start);
+    return written;
+}
+
+static int write_run(uint8_t* out, int count, uint16_t pixel) {
+    out[0] = 0x80 | (count - 1);
+    put_u16(out + 1, pixel);
+    return 3;
+}
+
+static int write_literal(uint8_t* out, const uint16_t* literal, int count) {
+    int written = 0;
+    while(count > 0) {
+        int length = count > 128 ? 128 : count;
+        out[written++] = length - 1;
+        for(int i = 0; i < length; i++) {
+            put_u16(out + written, literal[i]);
+            written += 2;
+        }
+
+        literal += length;
+        count -= length;
+    }
+
+    return written;
+}
+
+static uint16_t fletcher16(const uint8_t* data, int length) {
+    uint32_t sum1 = 0, sum2 = 0;
+    while(length > 0) {
+        // The sums can't overflow within 360 bytes, so only reduce them once per block
+        int block = length > 360 ? 360 : length;
+        length -= block;
+        while(block--) {
+            sum1 += *data++;
+            sum2 += sum1;
+        }
+
+        sum1 %= 255;
+        sum2 %= 255;
+    }
+
+    return (sum2 << 8) | sum1;
+}
+
+static void put_u16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static void put_u32(uint8_t* out, uint32_t value) {
+    put_u16(out, value & 0xFFFF);
+    put_u16(out + 2, value >> 16);
+}
@@ -1,4 +1,6 @@
-#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_system.h>
 #include <time.h>
 #include <math.h>
 #include <stdio.h>
@@ -6,6 +8,19 @@
 #include <string.h>
 
 #include "game.h"
+#include "highscore.h"
+#include "replay.h"
+#include "profiler.h"
+#include "stress.h"
+#include "pattern.h"
+#include "escape.h"
+#include "sprite.h"
+#include "timerwheel.h"
+#include "gameclock.h"
+#include "textformat.h"
+#include "particles.h"
+#include "tileflip.h"
+#include "statehash.h"
 
 /* Forward declaration of static methods */
 
@@ -17,6 +32,10 @@ static void tick(double dt, GameState* state);
 /*
  * Checks for collisions between the blocks and players. Advances the player score when
  * blocks have completely left the screen.
+ *
+ * Only looks at the blocks near the player; the falling blocks of each speed are kept lowest
+ * first (see GameBlocks.ring), so the blocks that have left the screen are popped from the
+ * oldest end, and the blocks level with the player are a run just after them.
  */
 static void check_collisions(GameState* state);
 
@@ -32,10 +51,18 @@ static void render(GameState* state);
 static void render_main_menu(GameState* state);
 
 /*
- * Renders the game (players score, blocks, player itself, etc)
+ * Renders the game (players score, blocks, player itself, etc) in a single
+ * pass, then hands the finished frame on to be checked for changes. Drawing in
+ * bands would only pay off with something working on each finished band in
+ * parallel (a partial display update), which the graphics library can't do.
  */
 static void render_game(GameState* state);
 
+/*
+ * Renders screen rows `top` (inclusive) to `bottom` (exclusive) of the game.
+ */
+static void render_band(GameState* state, int top, int bottom);
+
 /*
  * Renders the death/game over screen which displays the users score
  * briefly before automatically returning to menu (the user can also
@@ -43,14 +70,51 @@ static void render_game(GameState* state);
  */
 static void render_gameover(GameState* state);
 
+/*
+ * Fills the game's part of the screen (see GameState.field_x) with the colour provided.
+ */
+static void clear_field(const GameState* state, uint16_t colour);
+
+/*
+ * Takes/releases the lock that games running side by side hold while drawing text, as the
+ * graphics library's font and colour are shared. Does nothing outside of versus mode.
+ */
+static void lock_text();
+static void unlock_text();
+
 /*
  * When a block falls off the screen, we move it back up to the top to
  * provide the illusion of a new block.
  *
  * In reality, removing and recreating a block is a waste of time and memory
- * if we can just change the Y value instead.
+ * if we can just change the Y value instead. Each respawn picks a new size
+ * and speed for the block.
+ */
+static void respawn_block(GameState* state, int i);
+
+/*
+ * Puts the block at the index provided at the top of the screen, with the size and
+ * speed provided, and starts it falling. A negative `x` picks a random position.
+ *
+ * The position may be moved to leave the player a way out (see escape.c). Returns 0,
+ * leaving the block waiting, if there's nowhere safe for it right now.
+ */
+static int place_block(GameState* state, int i, int x, int size, int speed);
+
+/*
+ * Moves every block down by its own velocity. `step` is the fraction of a
+ * second that has passed, in 16.16 fixed point.
+ *
+ * Blocks that aren't on screen have a velocity of zero, so this needs no
+ * branches and the compiler is free to vectorise/pipeline it.
  */
-static void respawn_block(GameBlock* block);
+static void move_blocks(GameBlocks* blocks, int32_t step);
+
+/*
+ * Recalculates the velocity of every falling block from the game velocity
+ * and the block's own speed. Called whenever the game velocity changes.
+ */
+static void update_block_velocities(GameState* state);
 
 /*
  * Spawns all our blocks (MAX_BLOCKS)
@@ -69,20 +133,18 @@ static void initialise_blocks(GameState* state);
 static void enable_blocks(GameState* state, int toBlockIndex);
 
 /*
- * Draws the rectangle representing the block using the colour provided.
+ * Checks if the player provided is colliding with the block at the index provided,
+ * pixel for pixel using their sprite masks.
  *
- * If the X/Y position of the block is less than zero, the width/height
- * is reduced and the appropiatte X/Y value is set to zero to prevent
- * the underlying graphics method from crashing.
+ * Returns 1 if they are colliding, 0 otherwise.
  */
-static void draw_block(GameBlock b, uint16_t colour);
+static int check_player_collision(Player p, const GameBlocks* blocks, int i);
 
 /*
- * Checks if the player provided is colliding with the block provided.
- *
- * Returns 1 if they are colliding, 0 otherwise.
+ * Returns 1 if the block at the index provided is level with the player and
+ * within NEAR_MISS_DISTANCE of their side (without touching them).
  */
-static int check_player_collision(Player p, GameBlock b);
+static int check_near_miss(Player p, const GameBlocks* blocks, int i);
 
 /*
  * Uses the dt provided (in ms) to calculate the velocity.
@@ -91,30 +153,106 @@ static int calc_velocity(int vel, double dt);
 
 /*
  * Initialises the game by resetting the game state, player position,
- * velocity, etc.
+ * velocity, etc. The random number generator is seeded with `seed`.
+ */
+static void initialise_game(GameState* state, uint32_t seed);
+
+/*
+ * Game timer callbacks (see timerwheel.h); `arg` is the game state. Returns to the
+ * main menu if the game over screen is still showing, and accepts button presses again.
  */
-static void initialise_game(GameState* state);
+static void return_to_menu(void* arg);
+static void unlock_input(void* arg);
+
+// Held while drawing text; only created in versus mode
+static SemaphoreHandle_t text_lock = NULL;
 
 /* Method definitions */
 
+void gameInit(GameState* state) {
+    gameClockStart(&state->clock);
+    timerWheelReset(&state->timers);
+    particlesReset(&state->particles);
+
+    // Games side by side share the graphics library's font state, so take turns drawing text
+    if(VERSUS_MODE_ENABLED && text_lock == NULL) text_lock = xSemaphoreCreateMutex();
+
+    // Ignore button presses in the first second of runtime as the TTGO
+    // board seems to emit two button presses on GPIO pin 0 without
+    // any user action.
+    state->input_locked = 1;
+    timerSchedule(&state->timers, BOOT_INPUT_DELAY, unlock_input, state);
+}
+
+int gameRandom(GameState* state) {
+    // xorshift32; never reaches zero from a non-zero seed
+    uint32_t x = state->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    state->rng = x;
+
+    return x >> 1;
+}
+
+void gameStart(GameState* state, uint32_t seed) {
+    state->selection = 0;
+    state->phase = PHASE_GAME;
+    state->input_locked = 0;
+    initialise_game(state, seed);
+}
+
+void showDeathScreen(GameState* state) {
+    state->phase = PHASE_DEATH;
+    state->death_timer = timerSchedule(&state->timers, DEATH_SCREEN_DELAY, return_to_menu, state);
+
+    // Only respond after a moment incase user hit button trying to avoid
+    // block moments before death.
+    state->input_locked = 1;
+    timerSchedule(&state->timers, DEATH_INPUT_DELAY, unlock_input, state);
+}
+
 void handleTickPacket(GamePacket packet, GameState* state) {
-    // Move blocks, create new ones, advance velocity, move player, et
-    // Change the delta time from the tick packet to ms, as microseconds is a bit overkill
-    tick(packet.data / 1.0e3, state);
+    // The tick packet carries the real time that passed; the game moves by however
+    // much game time that was (none while paused, though the frame is still drawn)
+    int dt = gameClockAdvance(&state->clock, packet.data);
+    if(dt > 0) {
+        // Record the tick timing so the game can be replayed exactly
+        int playing = state->phase == PHASE_GAME;
+        if(playing) state->ticks++;
+        if(playing && state->instance == 0) replayRecordTick(dt);
+
+        // Fire any game timers that are due before the game moves on
+        timerWheelAdvance(&state->timers, dt);
+
+        // Move blocks, create new ones, advance velocity, move player, et
+        // Change the delta time to ms, as microseconds is a bit overkill
+        profilerBegin(PROFILE_TICK);
+        tick(dt / 1.0e3, state);
+        profilerEnd(PROFILE_TICK);
+
+        // The tick the player died on is hashed too, before the end of the game is marked
+        if(playing) stateHashTick(state);
+        if(playing && state->phase != PHASE_GAME) stateHashEnd(state);
+    }
+
+    // Nothing is drawn while time-warping
+    if(state->clock.headless) return;
 
     // Render the game world
+    profilerBegin(PROFILE_RENDER);
     render(state);
+    profilerEnd(PROFILE_RENDER);
 }
 
 void handleInputPacket(GamePacket packet, GameState* state) {
-    // Ignore button presses in first second of runtime as the TTGO
-    // board seems to emit two button presses on GPIO pin 0 without
-    // any user action.
-    if(esp_timer_get_time() < 1e6) return;
+    // Ignore button presses just after boot or death (see gameInit and showDeathScreen)
+    if(state->input_locked) return;
 
     int input = packet.data;
     if(state->phase == PHASE_GAME) {
         state->player_direction = input;
+        if(state->instance == 0) replayRecordInput(input);
     } else if(input != DIR_NONE) {
         switch(state->phase) {
             case PHASE_MENU:
@@ -124,17 +262,14 @@ void handleInputPacket(GamePacket packet, GameState* state) {
                     state->selection = 0;
                     state->phase = PHASE_GAME;
 
-                    initialise_game(state);
+                    initialise_game(state, esp_random());
                 }
 
                 break;
             case PHASE_DEATH:
                 // On death screen; if user has pressed button then go to menu.
-                // Only respond after 500ms incase user hit button trying to avoid
-                // block moments before death.
-                if(esp_timer_get_time() >= state->auto_advance_time - 4.5e6) {
-                    state->phase = PHASE_MENU;
-                }
+                state->phase = PHASE_MENU;
+                timerCancel(&state->timers, state->death_timer);
 
                 break;
             default:
@@ -144,28 +279,35 @@ void handleInputPacket(GamePacket packet, GameState* state) {
     }
 }
 
-static void initialise_game(GameState* state) {
-    // Create the RNG if not already created
-    static int generatorExists = 0;
-    if(!generatorExists) {
-        srand((unsigned int)time(NULL));
-        generatorExists = 1;
-    }
+static void initialise_game(GameState* state, uint32_t seed) {
+    // Seed the RNG afresh for every game, and record the seed; with it and the
+    // recorded inputs the game can be replayed exactly.
+    state->rng = seed != 0 ? seed : 1;
+    if(state->instance == 0) replayBeginGame(seed, state->block_limit);
+    stateHashBegin(state, seed);
 
     // Reset the state
+    state->ticks = 0;
     state->player_direction = DIR_NONE;
     state->velocity = STARTING_VELOCITY;
     state->selection = 0;
 
     // Reset the player
     Player* p = &state->player;
-    p->x = (display_width / 2) - PLAYER_WIDTH / 2;
+    p->x = (state->field_width / 2) - PLAYER_WIDTH / 2;
     p->y = display_height - PLAYER_HEIGHT - 5;
     p->score = 0;
 
     // Reset all blocks and re-enable only the required ones
     initialise_blocks(state);
-    enable_blocks(state, STARTING_BLOCKS);
+    patternReset(&state->pattern);
+    escapeReset(&state->escape);
+    particlesReset(&state->particles);
+    if(STRESS_MODE_ENABLED) {
+        stressBegin(state);
+    } else {
+        enable_blocks(state, STARTING_BLOCKS);
+    }
 }
 
 static int calc_velocity(int vel, double dt) {
@@ -173,13 +315,9 @@ static int calc_velocity(int vel, double dt) {
 }
 
 static void tick(double dt, GameState* state) {
-    // If we're on the death screen, check to see if the death screen has been showing
-    // for the allocated time already. If so, return to main menu.
-    if(state->phase == PHASE_DEATH && state->auto_advance_time <= esp_timer_get_time()) {
-        state->selection = 0;
-        state->phase = PHASE_MENU;
-    }
-    
+    // Effects keep playing out after death
+    particlesTick(&state->particles, dt);
+
     if(state->phase == PHASE_GAME) {
         // Move the player
         Player* p = &state->player;
@@ -192,39 +330,62 @@ static void tick(double dt, GameState* state) {
         // Keep player inside game
         if(p->x < 0) {
             p->x = 0;
-        } else if(p->x + PLAYER_WIDTH > display_width) {
-            p->x = display_width - PLAYER_WIDTH;
+        } else if(p->x + PLAYER_WIDTH > state->field_width) {
+            p->x = state->field_width - PLAYER_WIDTH;
         }
 
-        // Move/respawn blocks
-        GameBlock* block;
-        for(int i = 0; i < MAX_BLOCKS; i++) {
-            block = &state->blocks[i];
-            if(block->enabled) {
-                if(block->waiting_for_respawn) { respawn_block(block); }
+        if(STRESS_MODE_ENABLED) {
+            stressTick(dt, state);
+            return;
+        }
+
+        escapeAdvance(&state->escape, dt);
 
-                block->y += calc_velocity(state->velocity, dt);
+        // Spawn blocks from the scripted patterns, or at random if there aren't any, then move them all
+        GameBlocks* blocks = &state->blocks;
+        if(!SPAWN_PATTERNS_ENABLED || !patternTick(state, dt)) {
+            for(int i = 0; i < MAX_BLOCKS; i++) {
+                if(blocks->enabled[i] && blocks->waiting_for_respawn[i]) { respawn_block(state, i); }
             };
-        };
+        }
+
+        move_blocks(blocks, dt * 65536 / 1000);
 
         // Increase speed and amount of blocks as the users score rises
         if(p->score > 200) {
             int score_difference = p->score - 200;
             enable_blocks(state, (score_difference/300) + STARTING_BLOCKS);
-            state->velocity = STARTING_VELOCITY + (score_difference/400)*0.5;
+
+            int velocity = STARTING_VELOCITY + (score_difference/400)*0.5;
+            if(velocity != state->velocity) {
+                state->velocity = velocity;
+                update_block_velocities(state);
+            }
         }
 
+        profilerBegin(PROFILE_COLLISIONS);
         check_collisions(state);
+        profilerEnd(PROFILE_COLLISIONS);
     }
 };
 
 static void render(GameState* state) {
     switch(state->phase) {
         case PHASE_MENU:
+            lock_text();
             render_main_menu(state);
+            unlock_text();
             break;
         case PHASE_DEATH:
+            // Show the player's explosion over the field before the game over screen
+            if(particlesActive(&state->particles) > 0) {
+                render_game(state);
+                break;
+            }
+
+            lock_text();
             render_gameover(state);
+            unlock_text();
             break;
         case PHASE_GAME:
             render_game(state);
@@ -236,7 +397,24 @@ static void render(GameState* state) {
 };
 
 static void render_main_menu(GameState* state) {
-    cls(rgbToColour(190,190,190));
+    clear_field(state, rgbToColour(190,190,190));
+    if(state->field_width < display_width) {
+        // Half a screen has no room for the title; just say whose side this is
+        int x = state->field_x + 4;
+        setFont(FONT_UBUNTU16);
+        setFontColour(255, 255, 255);
+        print_xy(state->instance == 0 ? "Player 1" : "Player 2", x, 20);
+
+        setFont(FONT_SMALL);
+        setFontColour(100, 100, 100);
+        print_xy(state->instance == 0 ? "Left button" : "Right button", x, 50);
+        print_xy("turns you around", x, 50 + getFontHeight() + 4);
+
+        setFontColour(0,0,0);
+        print_xy("Press to Start", x, display_height - getFontHeight() - 4);
+        return;
+    }
+
     setFont(FONT_DEJAVU24);
     setFontColour(255, 255, 255);
     if(state->selection == 0) {
@@ -255,6 +433,14 @@ static void render_main_menu(GameState* state) {
         draw_rectangle(105, 155, 1, 12, rgbToColour(150,150,150));
         draw_rectangle(75, 185, 40, 30, rgbToColour(255, 0, 0));
 
+        if(highscoreAt(0) > 0) {
+            char best[32];
+            formatInt(formatText(best, "Best: "), highscoreAt(0), 0);
+            setFont(FONT_SMALL);
+            setFontColour(100, 100, 100);
+            print_xy(best, 22, 90);
+        }
+
         setFontColour(0,0,0);
         setFont(FONT_UBUNTU16);
         print_xy("Press to Start", 10, display_height - getFontHeight());
@@ -283,113 +469,323 @@ static void render_main_menu(GameState* state) {
 };
 
 static void render_game(GameState* state) {
-    cls(rgbToColour(0,0,0));
-    GameBlock b;
+    render_band(state, 0, display_height);
+
+    // Games side by side draw their halves at the same time, so leave their halves to the flip
+    if(state->field_width == display_width) tileFlipBand(0, display_height);
+};
+
+static void render_band(GameState* state, int top, int bottom) {
+    draw_rectangle(state->field_x, top, state->field_width, bottom - top, rgbToColour(0,0,0));
+
+    // Faster blocks are drawn in a hotter colour so the player can tell them apart
+    const uint16_t speed_colours[BLOCK_SPEED_COUNT] = {
+        rgbToColour(255, 0, 0), rgbToColour(170, 0, 40), rgbToColour(255, 120, 0)
+    };
+
+    const GameBlocks* blocks = &state->blocks;
     for(int i = 0; i < MAX_BLOCKS; i++) {
-        b = state->blocks[i];
-        if(b.enabled == 1 && b.waiting_for_respawn == 0) {
-            draw_block(b, rgbToColour(255, 0, 0));
+        int y = BLOCK_Y(blocks, i);
+        if(blocks->enabled[i] == 1 && blocks->waiting_for_respawn[i] == 0 && y < bottom && y + blocks->height[i] > top) {
+            if(state->render_backend == RENDER_BOXES) {
+                spriteFillRows(spriteBlock(blocks->size[i]), state->field_x + blocks->x[i], y, speed_colours[blocks->speed[i]], top, bottom);
+            } else {
+                spriteDrawRows(spriteBlock(blocks->size[i]), state->field_x + blocks->x[i], y, speed_colours[blocks->speed[i]], top, bottom);
+            }
         }
     }
 
+    if(STRESS_MODE_ENABLED) stressRender(state);
+
+    // The player is gone once they've exploded
     Player p = state->player;
-    draw_rectangle(p.x, p.y, PLAYER_WIDTH, PLAYER_HEIGHT, rgbToColour(0, 0, 255));
+    if(state->phase == PHASE_GAME) spriteDrawRows(spritePlayer(), state->field_x + p.x, p.y, rgbToColour(0, 0, 255), top, bottom);
+
+    particlesDraw(&state->particles, state->field_x, state->field_width, top, bottom);
+
+    // The score bar is drawn over the top band
+    if(top > 0) return;
 
+    lock_text();
     setFontColour(240,240,240);
-    draw_rectangle(0, 0, display_width, getFontHeight() + 4, rgbToColour(10, 10, 10));
+    draw_rectangle(state->field_x, 0, state->field_width, getFontHeight() + 4, rgbToColour(10, 10, 10));
 
     char score[32];
-    sprintf(score, "Score: %d", p.score);
-    print_xy(score, 1, 2);
+    if(STRESS_MODE_ENABLED) {
+        formatInt(formatText(score, "Blocks: "), stressBlockCount(), 0);
+    } else {
+        formatInt(formatText(score, "Score: "), p.score, 0);
+    }
+    print_xy(score, state->field_x + 1, 2);
+    unlock_text();
 };
 
 static void render_gameover(GameState* state) {
-    cls(rgbToColour(190,190,190));
+    int x = state->field_x;
+    clear_field(state, rgbToColour(190,190,190));
     setFontColour(255, 0, 0);
     setFont(FONT_DEJAVU18);
-    print_xy("Game over", 1, 20);
+    print_xy("Game over", x + 1, 20);
 
     setFont(FONT_UBUNTU16);
     setFontColour(255, 255, 255);
     char score[32];
-    sprintf(score, "Score: %04d", state->player.score);
-    print_xy(score, 1, 45);
-
-    int64_t current_time = esp_timer_get_time();
-    int64_t target_time = state->auto_advance_time;
-    double perc_time_remaining = 1 - (abs(target_time - current_time) / DEATH_SCREEN_DELAY);
+    formatInt(formatText(score, "Score: "), state->player.score, 4);
+    print_xy(score, x + 1, 45);
 
-    setFontColour(0,0,0);
+    // Show the high score table (as much as fits above the bar), highlighting this game's score if it placed
     setFont(FONT_SMALL);
-
     int bar_height = getFontHeight() * 2;
-    draw_rectangle(0, display_height - bar_height, display_width * perc_time_remaining, bar_height, rgbToColour(255, 255, 255));
-    print_xy("Press to Continue", 10, display_height - getFontHeight()*1.5);
+    for(int i = 0; i < HIGHSCORE_COUNT && highscoreAt(i) > 0; i++) {
+        if(80 + (i + 1) * (getFontHeight() + 4) > display_height - bar_height) break;
+
+        if(i == state->highscore_rank) {
+            setFontColour(255, 0, 0);
+        } else {
+            setFontColour(100, 100, 100);
+        }
+
+        formatInt(formatText(formatInt(score, i + 1, 0), ". "), highscoreAt(i), 4);
+        print_xy(score, x + 10, 80 + i * (getFontHeight() + 4));
+    }
+
+    int remaining = timerRemaining(&state->timers, state->death_timer);
+    double perc_time_remaining = 1 - (remaining < 0 ? 0 : remaining) / (double)DEATH_SCREEN_DELAY;
+
+    setFontColour(0,0,0);
+    draw_rectangle(x, display_height - bar_height, state->field_width * perc_time_remaining, bar_height, rgbToColour(255, 255, 255));
+    print_xy("Press to Continue", x + 10, display_height - getFontHeight()*1.5);
 };
 
+static void clear_field(const GameState* state, uint16_t colour) {
+    if(state->field_x == 0 && state->field_width == display_width) {
+        cls(colour);
+    } else {
+        draw_rectangle(state->field_x, 0, state->field_width, display_height, colour);
+    }
+}
+
+static void lock_text() {
+    if(text_lock != NULL) xSemaphoreTake(text_lock, portMAX_DELAY);
+}
+
+static void unlock_text() {
+    if(text_lock != NULL) xSemaphoreGive(text_lock);
+}
+
 static void check_collisions(GameState* state) {
+    const int heights[BLOCK_SIZE_COUNT] = BLOCK_SIZE_HEIGHTS;
     Player* p = &state->player;
-    for(int i = 0; i < MAX_BLOCKS; i++) {
-        GameBlock* block = &state->blocks[i];
-        if(block->enabled && block->waiting_for_respawn == 0) {
-            if(check_player_collision(*p, *block) == 1) {
-                state->phase = PHASE_DEATH;
-                state->auto_advance_time = esp_timer_get_time() + DEATH_SCREEN_DELAY;
-            } else if(block->y > display_height) {
-                block->waiting_for_respawn = 1;
-                p->score += 100;
+    GameBlocks* blocks = &state->blocks;
+
+    // Only bottom edges are in spawn order (top edges aren't, as sizes differ in height), so a
+    // block is taken off once its bottom edge is a tallest block's height below the screen;
+    // shorter blocks are scored a few pixels after they've left it
+    int tallest = 0;
+    for(int size = 0; size < BLOCK_SIZE_COUNT; size++) {
+        if(heights[size] > tallest) tallest = heights[size];
+    }
+
+    for(int speed = 0; speed < BLOCK_SPEED_COUNT; speed++) {
+        const uint8_t* ring = blocks->ring[speed];
+
+        // The blocks that have left the screen are the oldest; take them off the ring
+        while(blocks->ring_count[speed] > 0) {
+            int i = ring[blocks->ring_head[speed]];
+            if(BLOCK_Y(blocks, i) + blocks->height[i] <= display_height + tallest) break;
+
+            blocks->ring_head[speed] = (blocks->ring_head[speed] + 1) % MAX_BLOCKS;
+            blocks->ring_count[speed]--;
+
+            blocks->waiting_for_respawn[i] = 1;
+            blocks->velocity[i] = 0;
+            p->score += 100;
+        }
+
+        for(int n = 0; n < blocks->ring_count[speed]; n++) {
+            int i = ring[(blocks->ring_head[speed] + n) % MAX_BLOCKS];
+            int y = BLOCK_Y(blocks, i);
+
+            // This block, and every newer one, is still above the player
+            if(y + blocks->height[i] < p->y) break;
+
+            // Below the player already
+            if(y > p->y + PLAYER_HEIGHT) continue;
+
+            if(check_player_collision(*p, blocks, i) == 1) {
+                particlesEmit(&state->particles, EFFECT_EXPLOSION, p->x + PLAYER_WIDTH / 2, p->y + PLAYER_HEIGHT / 2);
+                showDeathScreen(state);
+
+                // Record the score; only updates the RAM copy of the table, the
+                // flash write happens later in the background. Re-runs of recorded
+                // games were entered when they were first played.
+                state->highscore_rank = state->replaying ? -1 : highscoreSubmit(p->score);
+                if(state->instance == 0) replayEndGame(p->score);
+                return;
+            } else if(blocks->near_missed[i] == 0 && check_near_miss(*p, blocks, i) == 1) {
+                // Throw sparks from the side of the player the block went past
+                blocks->near_missed[i] = 1;
+                int x = blocks->x[i] > p->x ? p->x + PLAYER_WIDTH : p->x;
+                particlesEmit(&state->particles, EFFECT_SPARKS, x, p->y + PLAYER_HEIGHT / 2);
             }
         }
     }
 };
 
-static int check_player_collision(Player p, GameBlock b) {
-    return !(p.x > b.x + BLOCK_WIDTH || p.x + PLAYER_WIDTH < b.x || p.y > b.y + BLOCK_HEIGHT || p.y + PLAYER_HEIGHT < b.y);
+static int check_player_collision(Player p, const GameBlocks* blocks, int i) {
+    return spriteCollide(spritePlayer(), p.x, p.y, spriteBlock(blocks->size[i]), blocks->x[i], BLOCK_Y(blocks, i));
+}
+
+static int check_near_miss(Player p, const GameBlocks* blocks, int i) {
+    int x = blocks->x[i];
+    int y = BLOCK_Y(blocks, i);
+    if(y > p.y + PLAYER_HEIGHT || y + blocks->height[i] < p.y) return 0;
+
+    int gap = x > p.x ? x - (p.x + PLAYER_WIDTH) : p.x - (x + blocks->width[i]);
+    return gap <= NEAR_MISS_DISTANCE;
 }
 
 static void enable_blocks(GameState* state, int toBlockIndex) {
+    if(state->block_limit > 0) toBlockIndex = state->block_limit;
+
+    GameBlocks* blocks = &state->blocks;
     for(int i = 0; i < MAX_BLOCKS; i++) {
         int enabled = i < toBlockIndex;
-        GameBlock* b = &state->blocks[i];
 
-        if(b->enabled == 0) {
-            b->enabled = enabled;
-            b->waiting_for_respawn = enabled;
+        if(blocks->enabled[i] == 0) {
+            blocks->enabled[i] = enabled;
+            blocks->waiting_for_respawn[i] = enabled;
         }
     }
 }
 
 static void initialise_blocks(GameState* state) {
-    for(int i = 0; i < MAX_BLOCKS; i++) {
-        (&state->blocks[i])->enabled = 0;
-        (&state->blocks[i])->waiting_for_respawn= 0;
-    };
+    memset(&state->blocks, 0, sizeof(GameBlocks));
+    state->last_spawned = -1;
 }
 
-static void respawn_block(GameBlock* block) {
-    if(block->enabled == 0) return;
+static void respawn_block(GameState* state, int i) {
+    GameBlocks* blocks = &state->blocks;
+    if(blocks->enabled[i] == 0) return;
+
+    // Blocks beyond the limit set from the console finish their fall, then stay off
+    if(state->block_limit > 0 && i >= state->block_limit) {
+        blocks->enabled[i] = 0;
+        return;
+    }
 
     // The last block we spawned. Used as a quick and dirty test to determine
     // if we need to poll for blocks close to the top of the screen or not
-    static GameBlock* last_spawned;
-
-    if(last_spawned == NULL || last_spawned->enabled == 0 || last_spawned->waiting_for_respawn == 1 || last_spawned->y > BLOCK_HEIGHT*1.5) {
-        block->y = BLOCK_HEIGHT * -1;
-        block->x = rand() % (display_width - BLOCK_WIDTH);
-        block->waiting_for_respawn = 0;
+    int last = state->last_spawned;
 
-        last_spawned = block;
+    if(last < 0 || blocks->enabled[last] == 0 || blocks->waiting_for_respawn[last] == 1 || BLOCK_Y(blocks, last) > blocks->height[last]*1.5) {
+        int size = gameRandom(state) % BLOCK_SIZE_COUNT;
+        int speed = gameRandom(state) % BLOCK_SPEED_COUNT;
+        place_block(state, i, -1, size, speed);
     }
 };
 
-static void draw_block(GameBlock b, uint16_t colour) {
-    int x = b.x < 0 ? 0 : b.x;
-    int y = b.y < 0 ? 0 : b.y;
-    int width = b.x < 0 ? BLOCK_WIDTH + b.x : BLOCK_WIDTH;
-    int height = b.y < 0 ? BLOCK_HEIGHT + b.y : BLOCK_HEIGHT;
+void setBlockLimit(GameState* state, int limit) {
+    state->block_limit = limit < 0 ? 0 : limit > MAX_BLOCKS ? MAX_BLOCKS : limit;
+    if(state->phase != PHASE_GAME) return;
 
-    if(width <= 0 || height <= 0) {return;}
+    // Recorded, so a re-run of the game changes it on the same tick
+    if(state->instance == 0) replayRecordBlockLimit(state->block_limit);
 
-    draw_rectangle(x, y, width, height, colour);
+    // Bring in any extra blocks straight away; blocks past the limit drop out as they respawn
+    if(state->block_limit > 0) enable_blocks(state, state->block_limit);
 }
 
+int spawnBlock(GameState* state, int x, int size, int speed) {
+    GameBlocks* blocks = &state->blocks;
+    int limit = state->block_limit > 0 ? state->block_limit : MAX_BLOCKS;
+    for(int i = 0; i < limit; i++) {
+        if(blocks->enabled[i] == 0 || blocks->waiting_for_respawn[i] == 1) {
+            // A refused block is left as it was, so it isn't enabled past the difficulty's block count
+            int enabled = blocks->enabled[i];
+            int waiting = blocks->waiting_for_respawn[i];
+            blocks->enabled[i] = 1;
+            blocks->waiting_for_respawn[i] = 1;
+            if(place_block(state, i, x, size, speed)) return i;
+
+            blocks->enabled[i] = enabled;
+            blocks->waiting_for_respawn[i] = waiting;
+            return -1;
+        }
+    }
+
+    return -1;
+}
+
+void unspawnBlock(GameState* state, int speed) {
+    GameBlocks* blocks = &state->blocks;
+    if(blocks->ring_count[speed] == 0) return;
+
+    // The newest block of a speed is the last in its ring
+    blocks->ring_count[speed]--;
+    int i = blocks->ring[speed][(blocks->ring_head[speed] + blocks->ring_count[speed]) % MAX_BLOCKS];
+    blocks->waiting_for_respawn[i] = 1;
+    blocks->velocity[i] = 0;
+}
+
+static int place_block(GameState* state, int i, int x, int size, int speed) {
+    const int widths[BLOCK_SIZE_COUNT] = BLOCK_SIZE_WIDTHS;
+    const int heights[BLOCK_SIZE_COUNT] = BLOCK_SIZE_HEIGHTS;
+    const int speed_quarters[BLOCK_SPEED_COUNT] = BLOCK_SPEED_QUARTERS;
+    GameBlocks* blocks = &state->blocks;
+
+    int width = widths[size];
+    int height = heights[size];
+    int velocity = state->velocity * speed_quarters[speed] / 4;
+
+    // Keep the whole block on screen, and make sure it leaves the player a way out
+    int max_x = state->field_width - width;
+    x = x < 0 ? gameRandom(state) % max_x : (x > max_x ? max_x : x);
+    x = escapePlace(state, x, width, height, velocity);
+    if(x < 0) return 0;
+
+    blocks->width[i] = width;
+    blocks->height[i] = height;
+    blocks->size[i] = size;
+    blocks->speed[i] = speed;
+    blocks->y[i] = -height * 65536;
+    blocks->x[i] = x;
+
+    blocks->waiting_for_respawn[i] = 0;
+    blocks->near_missed[i] = 0;
+    blocks->velocity[i] = velocity;
+    state->last_spawned = i;
+
+    // Newest at the end of its speed's ring; it's the highest block of that speed
+    int slot = (blocks->ring_head[speed] + blocks->ring_count[speed]) % MAX_BLOCKS;
+    blocks->ring[speed][slot] = i;
+    blocks->ring_count[speed]++;
+    return 1;
+}
+
+static void move_blocks(GameBlocks* blocks, int32_t step) {
+    for(int i = 0; i < MAX_BLOCKS; i++) {
+        blocks->y[i] += blocks->velocity[i] * step;
+    }
+}
+
+static void update_block_velocities(GameState* state) {
+    const int speed_quarters[BLOCK_SPEED_COUNT] = BLOCK_SPEED_QUARTERS;
+    GameBlocks* blocks = &state->blocks;
+    for(int i = 0; i < MAX_BLOCKS; i++) {
+        int falling = blocks->enabled[i] & !blocks->waiting_for_respawn[i];
+        blocks->velocity[i] = falling * (state->velocity * speed_quarters[blocks->speed[i]] / 4);
+    }
+}
+
+static void return_to_menu(void* arg) {
+    GameState* state = arg;
+    if(state->phase == PHASE_DEATH) {
+        state->selection = 0;
+        state->phase = PHASE_MENU;
+    }
+}
+
+static void unlock_input(void* arg) {
+    ((GameState*)arg)->input_locked = 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * The game clock. The game never reads the wall clock; all game time comes
+ * from here, and only moves when the game loop advances it with the real time
+ * that passed between ticks. This lets the game be paused, slowed down or sped
+ * up, and time-warped: ticked back-to-back headlessly, so minutes of play
+ * simulate in milliseconds through exactly the same code as a normal game.
+ */
+#include "gameclock.h"
+#include "game.h"
+
+// The real time (us) of a single tick at TARGET_FPS
+#define FRAME_TIME (1000000 / TARGET_FPS)
+
+/* Method definitions */
+
+void gameClockStart(GameClock* clock) {
+    *clock = (GameClock) {
+        .scale = GAME_CLOCK_SCALE
+    };
+}
+
+int gameClockAdvance(GameClock* clock, int dt) {
+    if(clock->paused) return 0;
+
+    // Scale in whole percent, carrying the remainder so no time is lost at odd speeds
+    int64_t scaled = (int64_t)dt * clock->scale + clock->carry;
+    int game_dt = scaled / 100;
+    clock->carry = scaled % 100;
+
+    clock->now += game_dt;
+    return game_dt;
+}
+
+int64_t gameClockNow(const GameClock* clock) {
+    return clock->now;
+}
+
+void gameClockSetPaused(GameClock* clock, int paused) {
+    clock->paused = paused;
+}
+
+void gameClockSetScale(GameClock* clock, int scale) {
+    if(scale < 0) scale = 0;
+    if(scale > GAME_CLOCK_MAX_SCALE) scale = GAME_CLOCK_MAX_SCALE;
+
+    clock->scale = scale;
+    clock->carry = 0;
+}
+
+int gameClockWarp(GameState* state, int duration) {
+    GameStatePhase phase = state->phase;
+    int64_t end = state->clock.now + (int64_t)duration * 1000;
+    int64_t start = state->clock.now;
+
+    state->clock.headless = 1;
+    while(state->clock.now < end && state->phase == phase) {
+        // A paused clock would never reach the end
+        if(state->clock.paused || state->clock.scale == 0) break;
+
+        GamePacket packet = {.type = PACKET_TICK, .data = FRAME_TIME};
+        handleTickPacket(packet, state);
+    }
+    state->clock.headless = 0;
+
+    return (state->clock.now - start) / 1000;
+}
@@ -0,0 +1,118 @@
+/*
+ * Persistent high score table, stored in NVS.
+ *
+ * Flash erase/write can take tens of milliseconds, which would be a very
+ * visible stutter if it happened in the game loop. Instead the table lives in
+ * RAM (loaded once at boot), submissions only ever update that copy, and a low
+ * priority task writes it back to flash in the background. The writer waits
+ * HIGHSCORE_WRITE_DELAY after being woken before it writes, so any further
+ * scores submitted in the meantime are coalesced in to the same write.
+ */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <nvs_flash.h>
+#include <nvs.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "highscore.h"
+
+#define NVS_NAMESPACE "falling_block"
+#define NVS_KEY "highscores"
+
+/* Forward declaration of static methods */
+
+/*
+ * The body of the low priority task that persists the table when notified.
+ */
+static void highscore_writer_task(void* arg);
+
+// The RAM copy of the table, best score first. Guarded by `table_lock` as the
+// writer task copies it while the game loop may be submitting a new score.
+static int table[HIGHSCORE_COUNT];
+static portMUX_TYPE table_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static nvs_handle_t nvs;
+static TaskHandle_t writer_task;
+
+/* Method definitions */
+
+void highscoreInit() {
+    esp_err_t err = nvs_flash_init();
+    if(err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        // The NVS partition is full or from an older layout; start afresh
+        nvs_flash_erase();
+        err = nvs_flash_init();
+    }
+
+    if(err == ESP_OK) {
+        err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    }
+
+    if(err != ESP_OK) {
+        printf("[WARNING] Unable to open NVS, high scores will not be saved: %s\n", esp_err_to_name(err));
+        return;
+    }
+
+    // A missing or differently sized blob just means an empty table
+    size_t length = sizeof(table);
+    if(nvs_get_blob(nvs, NVS_KEY, table, &length) != ESP_OK || length != sizeof(table)) {
+        memset(table, 0, sizeof(table));
+    }
+
+    xTaskCreate(highscore_writer_task, "Highscores", 3072, NULL, tskIDLE_PRIORITY + 1, &writer_task);
+}
+
+int highscoreSubmit(int score) {
+    if(score <= 0) return -1;
+
+    int position = -1;
+    portENTER_CRITICAL(&table_lock);
+    for(int i = 0; i < HIGHSCORE_COUNT; i++) {
+        if(score > table[i]) {
+            // Shift the lower scores down one place to make room
+            memmove(&table[i + 1], &table[i], (HIGHSCORE_COUNT - i - 1) * sizeof(int));
+            table[i] = score;
+            position = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&table_lock);
+
+    if(position >= 0 && writer_task != NULL) {
+        xTaskNotifyGive(writer_task);
+    }
+
+    return position;
+}
+
+int highscoreAt(int position) {
+    if(position < 0 || position >= HIGHSCORE_COUNT) return 0;
+
+    return table[position];
+}
+
+static void highscore_writer_task(void* arg) {
+    int pending[HIGHSCORE_COUNT];
+    while(1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Give any further scores a chance to arrive, then consume their notifications
+        // too so they're all covered by this one write.
+        vTaskDelay(pdMS_TO_TICKS(HIGHSCORE_WRITE_DELAY));
+        ulTaskNotifyTake(pdTRUE, 0);
+
+        portENTER_CRITICAL(&table_lock);
+        memcpy(pending, table, sizeof(table));
+        portEXIT_CRITICAL(&table_lock);
+
+        esp_err_t err = nvs_set_blob(nvs, NVS_KEY, pending, sizeof(pending));
+        if(err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+
+        if(err != ESP_OK) {
+            printf("[WARNING] Failed to save high scores: %s\n", esp_err_to_name(err));
+        }
+    }
+}
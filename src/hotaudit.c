@@ -0,0 +1,261 @@
+/*
+ * Hot path audit; counts every allocation and stdio call the game loop makes
+ * while ticking, handling input and flipping the frame, so we can hold the
+ * loop to zero of each.
+ *
+ * The project must be configured with -DHOT_PATH_AUDIT=ON, which links with
+ * `-Wl,--wrap` for each function audited: every call to, say, `malloc` in the
+ * app and IDF components is linked to `__wrap_malloc` below instead, which
+ * counts the call and hands it to the real `malloc`. Calls made from the ROM
+ * aren't relinked, so can't be seen.
+ *
+ * Calls are only counted on the task inside a window. The first call from
+ * each call site prints a backtrace (the ESP-IDF monitor turns the addresses
+ * in to file and line), and the report lists the count at each site.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hotaudit.h"
+
+#ifdef HOT_PATH_AUDIT
+#include <stdarg.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_debug_helpers.h>
+#include <soc/cpu.h>
+
+// The most call sites tracked, and how many frames of backtrace are printed for each
+#define MAX_SITES 32
+#define BACKTRACE_DEPTH 8
+
+// The functions audited; each must be wrapped in src/CMakeLists.txt
+typedef enum AuditedFunction {
+    FN_MALLOC,
+    FN_CALLOC,
+    FN_REALLOC,
+    FN_FREE,
+    FN_PRINTF,
+    FN_SPRINTF,
+    FN_SNPRINTF,
+    FN_PUTS,
+    FN_PUTCHAR,
+    FN_COUNT
+} AuditedFunction;
+
+typedef struct CallSite {
+    uint32_t pc;
+    uint8_t function;
+    uint8_t window;
+    uint32_t calls;
+} CallSite;
+
+/* Forward declaration of static methods */
+
+/*
+ * Counts a call to the function provided from the return address provided, if the
+ * calling task is inside a window.
+ */
+static void record(AuditedFunction function, void* return_address);
+
+/*
+ * Finds the call site provided, adding it (and printing a backtrace) if it's new.
+ * Returns NULL if the table is full.
+ */
+static CallSite* find_site(uint32_t pc, AuditedFunction function);
+
+/*
+ * Prints the calls counted in each window and at each call site, then resets the counts.
+ */
+static void report();
+
+// The real functions; --wrap links these to the originals
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+int __real_puts(const char* text);
+int __real_putchar(int c);
+
+static const char* function_names[FN_COUNT] = {
+    "malloc", "calloc", "realloc", "free", "printf", "sprintf", "snprintf", "puts", "putchar"
+};
+
+static const char* window_names[AUDIT_WINDOW_COUNT] = {"tick", "input", "flip"};
+
+// The window open (-1 for none) and the task that opened it
+static int window = -1;
+static TaskHandle_t owner = NULL;
+
+// Set while the audit itself is printing, so its own stdio calls aren't counted
+static int reporting = 0;
+
+static uint32_t calls[AUDIT_WINDOW_COUNT][FN_COUNT];
+static CallSite sites[MAX_SITES];
+static int site_count = 0;
+static uint32_t untracked = 0;
+static int frames = 0;
+#endif
+
+/* Method definitions */
+
+void hotAuditEnter(HotAuditWindow audit_window) {
+#ifdef HOT_PATH_AUDIT
+    owner = xTaskGetCurrentTaskHandle();
+    window = audit_window;
+#endif
+}
+
+void hotAuditExit() {
+#ifdef HOT_PATH_AUDIT
+    window = -1;
+#endif
+}
+
+void hotAuditFrameEnd() {
+#ifdef HOT_PATH_AUDIT
+    frames++;
+    if(frames == HOT_AUDIT_REPORT_INTERVAL) report();
+#endif
+}
+
+#ifdef HOT_PATH_AUDIT
+void* __wrap_malloc(size_t size) {
+    record(FN_MALLOC, __builtin_return_address(0));
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    record(FN_CALLOC, __builtin_return_address(0));
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    record(FN_REALLOC, __builtin_return_address(0));
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr) {
+    record(FN_FREE, __builtin_return_address(0));
+    __real_free(ptr);
+}
+
+// The variadic functions can't forward their arguments to the real function, so go through the v* variant
+int __wrap_printf(const char* format, ...) {
+    record(FN_PRINTF, __builtin_return_address(0));
+
+    va_list args;
+    va_start(args, format);
+    int written = vprintf(format, args);
+    va_end(args);
+    return written;
+}
+
+int __wrap_sprintf(char* out, const char* format, ...) {
+    record(FN_SPRINTF, __builtin_return_address(0));
+
+    va_list args;
+    va_start(args, format);
+    int written = vsprintf(out, format, args);
+    va_end(args);
+    return written;
+}
+
+int __wrap_snprintf(char* out, size_t size, const char* format, ...) {
+    record(FN_SNPRINTF, __builtin_return_address(0));
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(out, size, format, args);
+    va_end(args);
+    return written;
+}
+
+// The compiler turns printf calls with nothing to format in to puts/putchar, so those count too
+int __wrap_puts(const char* text) {
+    record(FN_PUTS, __builtin_return_address(0));
+    return __real_puts(text);
+}
+
+int __wrap_putchar(int c) {
+    record(FN_PUTCHAR, __builtin_return_address(0));
+    return __real_putchar(c);
+}
+
+static void record(AuditedFunction function, void* return_address) {
+    if(window < 0 || reporting || xTaskGetCurrentTaskHandle() != owner) return;
+
+    calls[window][function]++;
+
+    // The return address has the register window size in its top bits; strip them to get the call site
+    uint32_t pc = esp_cpu_process_stack_pc((uint32_t)return_address);
+    CallSite* site = find_site(pc, function);
+    if(site != NULL) {
+        site->calls++;
+    } else {
+        untracked++;
+    }
+
+    if(HOT_AUDIT_ABORT) {
+        reporting = 1;
+        printf("[HOTAUDIT] %s called in the %s window, aborting\n", function_names[function], window_names[window]);
+        abort();
+    }
+}
+
+static CallSite* find_site(uint32_t pc, AuditedFunction function) {
+    for(int i = 0; i < site_count; i++) {
+        if(sites[i].pc == pc && sites[i].function == function && sites[i].window == window) return &sites[i];
+    }
+
+    if(site_count == MAX_SITES) return NULL;
+
+    CallSite* site = &sites[site_count++];
+    *site = (CallSite) {.pc = pc, .function = function, .window = window};
+
+    reporting = 1;
+    printf("[HOTAUDIT] new call to %s in the %s window from 0x%08x\n", function_names[function], window_names[window], pc);
+    esp_backtrace_print(BACKTRACE_DEPTH);
+    reporting = 0;
+
+    return site;
+}
+
+static void report() {
+    reporting = 1;
+
+    uint32_t total = 0;
+    for(int w = 0; w < AUDIT_WINDOW_COUNT; w++) {
+        for(int f = 0; f < FN_COUNT; f++) total += calls[w][f];
+    }
+
+    if(total == 0) {
+        printf("[HOTAUDIT] no allocation or stdio calls in %d frames\n", frames);
+    } else {
+        printf("[HOTAUDIT] %u allocation/stdio calls in %d frames:\n", total, frames);
+        for(int w = 0; w < AUDIT_WINDOW_COUNT; w++) {
+            for(int f = 0; f < FN_COUNT; f++) {
+                if(calls[w][f] > 0) printf("[HOTAUDIT] %-5s %-8s %6u\n", window_names[w], function_names[f], calls[w][f]);
+            }
+        }
+
+        for(int i = 0; i < site_count; i++) {
+            if(sites[i].calls == 0) continue;
+
+            printf("[HOTAUDIT]   0x%08x %-8s %6u (%s)\n",
+                sites[i].pc, function_names[sites[i].function], sites[i].calls, window_names[sites[i].window]);
+            sites[i].calls = 0;
+        }
+
+        if(untracked > 0) printf("[HOTAUDIT]   %u calls from sites past the first %d\n", untracked, MAX_SITES);
+    }
+
+    for(int w = 0; w < AUDIT_WINDOW_COUNT; w++) {
+        for(int f = 0; f < FN_COUNT; f++) calls[w][f] = 0;
+    }
+    untracked = 0;
+    frames = 0;
+
+    reporting = 0;
+}
+#endif
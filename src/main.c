@@ -10,6 +10,7 @@
 #include <esp_system.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,15 +22,45 @@
 
 #include "core.h"
 #include "game.h"
+#include "spectator.h"
+#include "framestream.h"
+#include "highscore.h"
+#include "replay.h"
+#include "power.h"
+#include "ticktimer.h"
+#include "profiler.h"
+#include "pattern.h"
+#include "sprite.h"
+#include "gameclock.h"
+#include "hotaudit.h"
+#include "console.h"
+#include "tileflip.h"
+#include "suspend.h"
+
+#if VERSUS_MODE_ENABLED && STRESS_MODE_ENABLED
+#error "The stress mode can't be played in versus mode"
+#endif
+
+// One of the physical buttons; passed to the ISR as its context
+typedef struct GameButton {
+    gpio_num_t pin;
+
+    // The direction pressing this button moves the player
+    GameStateDirection direction;
+
+    // Whether the button is down, and when it last changed (for debouncing)
+    int pressed;
+    int64_t last_change_time;
+} GameButton;
 
 /* Forward declaration of static methods */
 
 /*
- * This is the main point of the game-loop. It continues to run inifitely, polling for interrupts and
- * timer callbacks present in the packet_queue.
+ * This is the main point of the game-loop. It continues to run inifitely, waiting to be notified
+ * of a tick from the tick timer or of inputs queued in the packet_queue by the GPIO interrupt.
  * 
- * Each time an event is found inside the packet_queue, it's dispatched to the `game_tick` function, which
- * will handle the update, collisions, scoring and redrawing of the game.
+ * Each tick is dispatched to the `handleTickPacket` function, which will handle the update,
+ * collisions, scoring and redrawing of the game.
  */
 static void start_game();
 
@@ -40,34 +71,71 @@ static void start_game();
 static void configure_gpio();
 
 /*
- * The ISR handler for the GPIO pins allocated to the physical buttons on the board.
- * 
- * This handler is responsible for debouncing and dispatching the button presses
- * to the game loop via the `packet_queue`
+ * Plays a game headlessly (see HEADLESS_WARP_SECONDS) by time-warping the game clock, and
+ * prints how much faster than real time it ran.
  */
-static void gpio_button_isr_handler(void* gpio_arg);
+static void run_headless_benchmark(GameState* state);
 
 /*
- * Configures and starts the ESP high-resolution timer, targetting the TARGET_FPS defined above.
- * 
- * Runs the `game_tick_timer_callback` method every tick
+ * Hands a button press or release to the game it belongs to. In versus mode each player
+ * has one button and each press turns them around; the second player's presses are queued
+ * for the task running their game.
+ */
+static void dispatch_input(GamePacket packet);
+
+/*
+ * Called when the games have been restored from deep sleep; holds their clocks
+ * until the button that woke the board is let go, if it's still down.
+ */
+static void hold_resumed_games();
+
+/*
+ * Turns the player of the versus game provided around (or advances its menus).
+ */
+static void versus_press(GameState* state);
+
+/*
+ * The task running the second player's game in versus mode, on the other core. Each tick
+ * it's handed the dt, ticks and draws its half of the screen, then signals `versus_done`.
  */
-static void configure_hw_timer();
+static void versus_task(void* arg);
 
-/**
- * Runs every tick of the game. Use this oppourtunity to calculate the delta time, and then
- * queue this information in the `packet_queue` for handling by our game.
+/*
+ * The ISR handler for the GPIO pins allocated to the physical buttons on the board.
  * 
- * Generates an update packet with type TICK, and the data being the delta time since last update
+ * This handler is responsible for debouncing and dispatching the button presses
+ * to the game loop via the `packet_queue`
  */
-static void game_tick_timer_callback();
+static void gpio_button_isr_handler(void* button_arg);
 
-// The packet_queue stores any updates we're dispatching to the game loop
-// from outside the loop (a timer callback or GPIO interrupt)
+// The packet_queue stores the input updates we're dispatching to the game loop
+// from outside the loop (GPIO interrupt)
 QueueHandle_t packet_queue;
 
-// The ESP timer we're using to drive the game loop
-esp_timer_handle_t game_timer;
+// The task running the game loop; notified by the tick timer and GPIO interrupt
+// when there's work for it (see GAME_NOTIFY_TICK/GAME_NOTIFY_INPUT)
+TaskHandle_t game_task;
+
+// The games being played; one, or one per player (and core) in versus mode. Each game's state
+// includes the players score, movement and what state of the game we're in (menu, game, game over, etc)
+static GameState games[VERSUS_MODE_ENABLED ? 2 : 1];
+
+// Versus mode; the second player's game task, its queue of button presses, and the signal that it
+// has drawn its half of the frame
+static TaskHandle_t versus_handle;
+static QueueHandle_t versus_queue;
+static SemaphoreHandle_t versus_done;
+
+// Set after resuming from deep sleep until a button is let go; button presses are ignored meanwhile,
+// and the clocks of the games that were running are held (see hold_resumed_games)
+static int resume_hold;
+static int resume_paused[VERSUS_MODE_ENABLED ? 2 : 1];
+
+// The buttons: GPIO 0 (left) and GPIO 35 (right)
+static GameButton buttons[2] = {
+    {.pin = GPIO_NUM_0, .direction = DIR_LEFT},
+    {.pin = GPIO_NUM_35, .direction = DIR_RIGHT}
+};
 
 /* Method definitions */
 
@@ -77,17 +145,48 @@ esp_timer_handle_t game_timer;
  * program.
  */
 void app_main() {
-    // Create our tick queue; used to dispatch events to the logic of the game without
-    // doing all logic inside of high-priority callback functions from the esp_timer.
-    // The data passed will be our dT (delta time), which is the amount of time that has
-    // passed since the last update tick was dispatched.
+    // Create our input queue; used to dispatch button presses to the logic of the game without
+    // doing all logic inside of the high-priority GPIO interrupt.
     packet_queue = xQueueCreate(10, sizeof(GamePacket));
 
+    // Find out whether we've woken from deep sleep with games to resume, before the display is touched
+    suspendInit();
+
+    // The game loop runs on this task (see start_game)
+    game_task = xTaskGetCurrentTaskHandle();
+
+    // Let the CPU drop to a lower frequency when it isn't working on a frame
+    powerInit();
+
+    // Set up the performance counters on this core, which the game loop runs on
+    profilerInit();
+
+    // Load the high score table from flash while nothing else is running
+    highscoreInit();
+
+    // Find where to record the next game, and start the background replay writer
+    replayInit();
+
+    // Check the spawn patterns embedded in flash
+    patternInit();
+
+    // Build the collision masks of the player and blocks
+    spriteInit();
+
     // Configure the direction and interrupts of our GPIO pins
     configure_gpio();
 
     // Create and start our game timer
-    configure_hw_timer();
+    tickTimerStart(game_task);
+
+    // Start streaming the game to spectators (if enabled)
+    spectatorInit();
+
+    // Start streaming the framebuffer to remote viewers (if enabled)
+    frameStreamInit();
+
+    // Listen for commands on the serial console; after the streams, which may share its UART
+    consoleInit();
 
     // Initialise graphics library and start game
     graphics_init();
@@ -96,47 +195,108 @@ void app_main() {
 
 
 static void start_game() {
-    // Set to portrait
-    set_orientation(1);
-
-    // This state struct contains the current state of the game,
-    // including the players score, movement and what state of the game
-    // we're in (menu, game, game over, etc)
-    GameState state = {
-        .phase = PHASE_MENU
-    };
+    // Set to portrait, or landscape in versus mode so each player's half is wide enough to play in
+    set_orientation(VERSUS_MODE_ENABLED ? 0 : 1);
+
+    // Each game gets an equal share of the screen
+    int count = sizeof(games) / sizeof(games[0]);
+    for(int i = 0; i < count; i++) {
+        games[i] = (GameState) {
+            .instance = i,
+            .field_x = i * display_width / count,
+            .field_width = display_width / count,
+            .phase = PHASE_MENU,
+            .highscore_rank = -1,
+            .last_spawned = -1
+        };
+        gameInit(&games[i]);
+    }
+
+    // Carry on with the games suspended to deep sleep instead, if we've just woken from it
+    int resumed = suspendRestore(games, count);
+    if(resumed) hold_resumed_games();
+
+    if(VERSUS_MODE_ENABLED) {
+        versus_queue = xQueueCreate(10, sizeof(GamePacket));
+        versus_done = xSemaphoreCreateBinary();
+        xTaskCreatePinnedToCore(versus_task, "Versus", VERSUS_TASK_STACK, &games[1],
+            uxTaskPriorityGet(NULL), &versus_handle, 1 - xPortGetCoreID());
+    }
+
+    GameState* state = &games[0];
+    if(HEADLESS_WARP_SECONDS > 0 && !resumed) run_headless_benchmark(state);
 
     int frame = 0;
     int64_t start_time = esp_timer_get_time();
     
     GamePacket packet;
     while(1) {
-        // Keep iterating until we find a packet inside our queue.
-        // This is used so that the high-priority callbacks/ISR functions are free as soon as is possible.
-        BaseType_t res = xQueueReceive(packet_queue, &packet, 10);
-        if(res == pdTRUE) {
-            if(packet.type == PACKET_TICK) {
-                // Dispatch tick game_update to game logic
-                handleTickPacket(packet, &state);
-                // Flip the frame to display new graphics
-                flip_frame();
-
-                // FPS tracking
-                frame++;
-                if(frame % TARGET_FPS == 0) {
-                    double fps = frame / (( esp_timer_get_time() - start_time ) / 1.0e6);
-                    printf("FPS: %f (%d) @ frame #%d\n", fps, TARGET_FPS, frame);
-                }
-            } else if(packet.type == PACKET_INPUT) {
-                // Dispatch input game_update to game logic
-                handleInputPacket(packet, &state);
-            }
+        // Block until there's a tick or input for us. Blocking here (rather than polling)
+        // is what yields to the idle task and keeps the watchdog fed.
+        uint32_t events = 0;
+        xTaskNotifyWait(0, ULONG_MAX, &events, 10);
+
+        // Dispatch any input game_updates to game logic before the tick, so they apply to it
+        while(xQueueReceive(packet_queue, &packet, 0) == pdTRUE) {
+            suspendActivity();
+            hotAuditEnter(AUDIT_INPUT);
+            dispatch_input(packet);
+            hotAuditExit();
         }
 
-        if(frame % TARGET_FPS || res == pdFALSE) {
-            // Prevent watchdog from terminating due to failure to yield
-            vTaskDelay(1);
+        if(events & GAME_NOTIFY_TICK) {
+            packet = (GamePacket) {
+                .type = PACKET_TICK,
+                .data = tickTimerTakeDt()
+            };
+
+            // Hold the CPU at the render frequency until the frame has been flipped
+            powerFrameBegin();
+            profilerFrameBegin();
+
+            // In versus mode the other core ticks and draws the second player's half meanwhile
+            if(VERSUS_MODE_ENABLED) xTaskNotify(versus_handle, packet.data, eSetValueWithOverwrite);
+
+            // Dispatch tick game_update to game logic
+            hotAuditEnter(AUDIT_TICK);
+            handleTickPacket(packet, state);
+            hotAuditExit();
+
+            // Both halves must be drawn before the frame is flipped
+            if(VERSUS_MODE_ENABLED) xSemaphoreTake(versus_done, portMAX_DELAY);
+
+            profilerBegin(PROFILE_STREAMING);
+            // Send what changed this tick to any spectators
+            spectatorEmit(state);
+            // Send the tiles of the frame that changed to any remote viewers
+            frameStreamCapture();
+            profilerEnd(PROFILE_STREAMING);
+
+            // Flip the frame to display new graphics, if any changed
+            profilerBegin(PROFILE_FLIP);
+            hotAuditEnter(AUDIT_FLIP);
+            tileFlipFrame();
+            hotAuditExit();
+            profilerEnd(PROFILE_FLIP);
+            suspendFrameShown();
+
+            profilerFrameEnd();
+            powerFrameEnd();
+            hotAuditFrameEnd();
+
+            // FPS tracking
+            frame++;
+            if(frame % TARGET_FPS == 0) {
+                double fps = frame / (( esp_timer_get_time() - start_time ) / 1.0e6);
+                printf("FPS: %f (%d) @ frame #%d\n", fps, TARGET_FPS, frame);
+            }
         }
+
+        // Run any command typed in to the console, now the frame is done
+        consolePoll(games, count);
+
+        // Holding both buttons (or leaving the game alone) suspends it to deep sleep
+        if(suspendDue(buttons[0].pressed && buttons[1].pressed)) suspendNow(games, count);
     }
 
     // Game loop has ended; this shouldn't ever happen as this code should be unreachable. However, if the loop
@@ -145,6 +305,108 @@ static void start_game() {
 }
 
 
+static void run_headless_benchmark(GameState* state) {
+    // Get past the boot input lock, then start a game the way a player would
+    gameClockWarp(state, BOOT_INPUT_DELAY);
+    GamePacket press = {.type = PACKET_INPUT, .data = DIR_LEFT};
+    handleInputPacket(press, state);
+    handleInputPacket(press, state);
+
+    int64_t start = esp_timer_get_time();
+    int simulated = 0;
+    while(simulated < HEADLESS_WARP_SECONDS * 1000 && state->phase == PHASE_GAME) {
+        // Warp a second at a time, yielding in between so the idle task can feed the watchdog
+        simulated += gameClockWarp(state, 1000);
+        vTaskDelay(1);
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    printf("[HEADLESS] Simulated %.1fs of play in %.1fms (%.0fx real time), score %d\n",
+        simulated / 1.0e3, elapsed / 1.0e3, simulated * 1.0e3 / elapsed, state->player.score);
+}
+
+
+static void dispatch_input(GamePacket packet) {
+    // After resuming, the button that woke the board is probably still down; start again once it's let go
+    if(resume_hold) {
+        if(packet.data != DIR_NONE) return;
+
+        resume_hold = 0;
+        int count = sizeof(games) / sizeof(games[0]);
+        for(int i = 0; i < count; i++) {
+            if(resume_paused[i]) gameClockSetPaused(&games[i].clock, 0);
+        }
+
+        // The release still goes to the game; the player was suspended mid-gesture, still moving
+    }
+
+    if(!VERSUS_MODE_ENABLED) {
+        handleInputPacket(packet, &games[0]);
+        return;
+    }
+
+    // Only presses matter in versus mode; the left button is player 1's, the right player 2's
+    if(packet.data == DIR_NONE) return;
+
+    if(packet.data == DIR_LEFT) {
+        versus_press(&games[0]);
+    } else {
+        xQueueSend(versus_queue, &packet, 0);
+    }
+}
+
+static void hold_resumed_games() {
+    int count = sizeof(games) / sizeof(games[0]);
+
+    // A tap is usually over before the button interrupts are set up (the bootloader checks the
+    // whole app first), and then there's no release coming to wait for
+    if(gpio_get_level(GPIO_NUM_35) == 1) {
+        printf("[SLEEP] Resumed %d game%s\n", count, count == 1 ? "" : "s");
+        return;
+    }
+
+    for(int i = 0; i < count; i++) {
+        // Games paused from the console stay paused
+        resume_paused[i] = !games[i].clock.paused;
+        if(resume_paused[i]) gameClockSetPaused(&games[i].clock, 1);
+    }
+
+    resume_hold = 1;
+
+    // The restored games are past the boot input lock (see gameInit)
+    printf("[SLEEP] Resumed %d game%s; release the button to carry on\n", count, count == 1 ? "" : "s");
+}
+
+static void versus_press(GameState* state) {
+    GamePacket turn = {
+        .type = PACKET_INPUT,
+        .data = state->player_direction == DIR_RIGHT ? DIR_LEFT : DIR_RIGHT
+    };
+    handleInputPacket(turn, state);
+}
+
+static void versus_task(void* arg) {
+    GameState* state = arg;
+    while(1) {
+        uint32_t dt = 0;
+        xTaskNotifyWait(0, ULONG_MAX, &dt, portMAX_DELAY);
+
+        GamePacket packet;
+        while(xQueueReceive(versus_queue, &packet, 0) == pdTRUE) {
+            versus_press(state);
+        }
+
+        packet = (GamePacket) {
+            .type = PACKET_TICK,
+            .data = dt
+        };
+        handleTickPacket(packet, state);
+
+        xSemaphoreGive(versus_done);
+    }
+}
+
+
 static void configure_gpio() {
     // First, configure the direction of the GPIO pins we're using (0 and 35)
     gpio_set_direction(GPIO_NUM_0, GPIO_MODE_INPUT);
@@ -158,87 +420,45 @@ static void configure_gpio() {
     gpio_install_isr_service(ESP_INTR_FLAG_LEVEL1);
 
     // And attach the handler to the service
-    gpio_isr_handler_add(GPIO_NUM_0, gpio_button_isr_handler, (void*)GPIO_NUM_0);
-    gpio_isr_handler_add(GPIO_NUM_35, gpio_button_isr_handler, (void*)GPIO_NUM_35);
+    gpio_isr_handler_add(GPIO_NUM_0, gpio_button_isr_handler, &buttons[0]);
+    gpio_isr_handler_add(GPIO_NUM_35, gpio_button_isr_handler, &buttons[1]);
 }
 
 
-static void IRAM_ATTR gpio_button_isr_handler(void* gpio_arg) {
+static void IRAM_ATTR gpio_button_isr_handler(void* button_arg) {
     // First, debounce the button press. Store the current time now for use
-    static int64_t last_press_time = 0;
+    GameButton* button = button_arg;
     int64_t current_time = esp_timer_get_time();
-    int gpio_pin = (int)gpio_arg;
-
-    // Used to detect when a button was pressed, and then released.
-    // Starts at both buttons unpressed (0)
-    static int button_status[2] = {1,1};
 
-    // Find whether or not this button is currently pressed down
-    // If pin is 35, comparison will return TRUE (1), otherwise FALSE (0). We can use
-    // these integers to index our static array of button states
-    int isPressed = button_status[gpio_pin == 35];
+    // The interrupt alternates between firing on press and on release (see the end of
+    // this handler), so this is a press if the button was up
+    int is_press = !button->pressed;
 
     // Time since last change must be more than 500us to continue (debounce)
-    if(current_time - last_press_time > 500) {
+    if(current_time - button->last_change_time > 500) {
         GamePacket packet = {.type = PACKET_INPUT};
-        if(isPressed == 1) {
-            // The button attached to this GPIO pin was just pressed down
+        if(is_press) {
+            // The button was just pressed down
             // Set the direction of movement to the direction this button correlates with
-            packet.data = gpio_pin == 35 ? DIR_RIGHT : DIR_LEFT;
+            packet.data = button->direction;
         } else {
-            // The button attached to this GPIO pin was just released
+            // The button was just released
             // Set direction of movement back to NONE
             packet.data = DIR_NONE;
         }
 
+        // Queue the input and wake the game loop to handle it
+        BaseType_t woken = pdFALSE;
         xQueueSendFromISR(packet_queue, &packet, 0);
+        xTaskNotifyFromISR(game_task, GAME_NOTIFY_INPUT, eSetBits, &woken);
+        if(woken == pdTRUE) portYIELD_FROM_ISR();
     }
 
-    // Store the new updated state of the button
-    button_status[gpio_pin == 35] = !isPressed;
-
-    // Refresh the stored static time for debouncing
-    last_press_time = current_time;
+    // Store the new state of the button, and when it changed for debouncing
+    button->pressed = is_press;
+    button->last_change_time = current_time;
 
     // Stop the iterrupt being fired again just because we're holding the button/helps debounce
     // by only responding to the opposite type of action that we're currently responding to
-    gpio_set_intr_type(gpio_pin, isPressed ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
-}
-
-static void game_tick_timer_callback() {
-    // Before we dispatch our event, we must first calculate the time that has passed.
-    // `last_time` is a static here so it survives repeat invocations. We'll use this to store the current
-    // time once we're done. This allows us to use it to compare against the current time now.
-    static int64_t last_time = 0;
-
-    // Calculate the time that has passed since the last time we were here
-    int64_t dt = esp_timer_get_time() - last_time;
-
-    // Update the last_time static to store the new, current time
-    last_time = esp_timer_get_time();
-
-    // Create our game_update packet
-    const GamePacket update = {
-        .type = PACKET_TICK,
-        .data = dt
-    };
-
-    // Dispatch our update packet to the game loop
-    xQueueSend(packet_queue, &update, 0);
-}
-
-
-static void configure_hw_timer() {
-    // To reduce complexity when handling light-sleep, dynamic frequency, etc.. we're using the high-resoultion
-    // timers provided by ESP-IDF, rather than the low-priority timers provided by FreeRTOS.
-
-    // Let's create our timer now
-    const esp_timer_create_args_t game_tick_args = {
-        .callback = &game_tick_timer_callback,
-        .name = "Gametimer"
-    };
-    esp_timer_create(&game_tick_args, &game_timer);
-
-    // Start the timer to run at 30 ticks per second (second / target runs per second) converted to microseconds
-    esp_timer_start_periodic(game_timer, 1.0e6/TARGET_FPS);
+    gpio_set_intr_type(button->pin, is_press ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
 }
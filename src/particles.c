@@ -0,0 +1,166 @@
+/*
+ * Particle effects; an explosion when the player dies, and sparks when a block
+ * only just misses them.
+ *
+ * Effects must never push a frame over budget, so their cost is bounded by
+ * construction rather than by how busy the game gets. Each game has a fixed
+ * pool of PARTICLE_COUNT particles (see ParticlePool), stored as parallel
+ * arrays with the live particles packed at the front, oldest first:
+ *     - emitting more than fit culls the oldest particles to make room, so
+ *       there are never more than PARTICLE_COUNT to move or draw,
+ *     - movement is a single fixed point loop over the live particles, which
+ *       also packs the survivors down (keeping their order),
+ *     - drawing fills each particle's square straight in to the framebuffer,
+ *       so a frame costs at most PARTICLE_COUNT * PARTICLE_SIZE ^ 2 pixel writes.
+ *
+ * Effects have their own random number generator, so emitting particles never
+ * changes the blocks a game spawns (and replays stay exact).
+ */
+#include <string.h>
+
+#include "particles.h"
+#include "pixelstats.h"
+
+/* Forward declaration of static methods */
+
+/*
+ * Removes the `amount` oldest particles, moving the rest down to the front of the pool.
+ */
+static void cull_oldest(ParticlePool* pool, int amount);
+
+/*
+ * The next number from the pool's random number generator, between `min` and `max` inclusive.
+ */
+static int random_between(ParticlePool* pool, int min, int max);
+
+/* Method definitions */
+
+void particlesReset(ParticlePool* pool) {
+    pool->count = 0;
+    pool->gravity_carry = 0;
+    if(pool->rng == 0) pool->rng = 0x2545F491;
+}
+
+void particlesEmit(ParticlePool* pool, ParticleEffect effect, int x, int y) {
+    // How many particles the effect throws, how fast (pixels per second), for how long (ms) and in which colours
+    int amount, min_speed, max_speed, min_life, max_life;
+    uint16_t colours[3];
+    if(effect == EFFECT_EXPLOSION) {
+        amount = 48;
+        min_speed = 30;
+        max_speed = 140;
+        min_life = 500;
+        max_life = 900;
+        colours[0] = rgbToColour(0, 0, 255);
+        colours[1] = rgbToColour(255, 120, 0);
+        colours[2] = rgbToColour(255, 220, 0);
+    } else {
+        amount = 8;
+        min_speed = 20;
+        max_speed = 80;
+        min_life = 150;
+        max_life = 300;
+        colours[0] = rgbToColour(255, 255, 255);
+        colours[1] = rgbToColour(255, 220, 0);
+        colours[2] = rgbToColour(255, 255, 160);
+    }
+
+    if(amount > PARTICLE_COUNT) amount = PARTICLE_COUNT;
+    if(pool->count + amount > PARTICLE_COUNT) cull_oldest(pool, pool->count + amount - PARTICLE_COUNT);
+
+    for(int n = 0; n < amount; n++) {
+        int i = pool->count++;
+        int speed = random_between(pool, min_speed, max_speed);
+
+        // Explosions fly out every way (a little more upwards); sparks only fly up
+        int vx = random_between(pool, -speed, speed);
+        int vy = effect == EFFECT_EXPLOSION ? random_between(pool, -speed, speed) - speed / 3 : random_between(pool, -speed, 0);
+
+        pool->x[i] = x * 65536;
+        pool->y[i] = y * 65536;
+        pool->vx[i] = vx;
+        pool->vy[i] = vy;
+        pool->life[i] = random_between(pool, min_life, max_life);
+        pool->colour[i] = colours[random_between(pool, 0, 2)];
+    }
+}
+
+void particlesTick(ParticlePool* pool, double dt) {
+    int32_t step = dt * 65536 / 1000;
+    // Carry the part of a pixel per second each tick leaves over, so falling doesn't depend on the frame rate
+    int64_t pull = (int64_t)(PARTICLE_GRAVITY * dt * 1000) + pool->gravity_carry;
+    int gravity = pull / 1000000;
+    pool->gravity_carry = pull % 1000000;
+    int elapsed = dt + 0.5;
+    if(elapsed < 1 && dt > 0) elapsed = 1;
+
+    // Move every particle, packing the survivors down so the oldest stay first
+    int kept = 0;
+    for(int i = 0; i < pool->count; i++) {
+        int life = pool->life[i] - elapsed;
+        int vy = pool->vy[i] + gravity;
+        int32_t y = pool->y[i] + vy * step;
+        if(life <= 0 || (y >> 16) >= display_height) continue;
+
+        pool->x[kept] = pool->x[i] + pool->vx[i] * step;
+        pool->y[kept] = y;
+        pool->vx[kept] = pool->vx[i];
+        pool->vy[kept] = vy;
+        pool->life[kept] = life;
+        pool->colour[kept] = pool->colour[i];
+        kept++;
+    }
+
+    pool->count = kept;
+}
+
+void particlesDraw(const ParticlePool* pool, int field_x, int field_width, int top, int bottom) {
+    for(int i = 0; i < pool->count; i++) {
+        int x = pool->x[i] >> 16;
+        int y = pool->y[i] >> 16;
+
+        // Particles are small enough to skip rather than clip when they reach an edge
+        if(x < 0 || y < 0 || x + PARTICLE_SIZE > field_width || y + PARTICLE_SIZE > display_height) continue;
+
+        // Only the rows of the particle inside the band being drawn
+        int first = y < top ? top - y : 0;
+        int last = y + PARTICLE_SIZE > bottom ? bottom - y : PARTICLE_SIZE;
+        if(first >= last) continue;
+
+        uint16_t colour = pool->colour[i];
+        pixelStatsRect(field_x + x, y + first, PARTICLE_SIZE, last - first);
+        uint16_t* row = frame_buffer + (y + first) * display_width + field_x + x;
+        for(int r = first; r < last; r++) {
+            for(int c = 0; c < PARTICLE_SIZE; c++) row[c] = colour;
+            row += display_width;
+        }
+    }
+}
+
+int particlesActive(const ParticlePool* pool) {
+    return pool->count;
+}
+
+static void cull_oldest(ParticlePool* pool, int amount) {
+    if(amount > pool->count) amount = pool->count;
+
+    int remaining = pool->count - amount;
+    memmove(pool->x, pool->x + amount, remaining * sizeof(pool->x[0]));
+    memmove(pool->y, pool->y + amount, remaining * sizeof(pool->y[0]));
+    memmove(pool->vx, pool->vx + amount, remaining * sizeof(pool->vx[0]));
+    memmove(pool->vy, pool->vy + amount, remaining * sizeof(pool->vy[0]));
+    memmove(pool->life, pool->life + amount, remaining * sizeof(pool->life[0]));
+    memmove(pool->colour, pool->colour + amount, remaining * sizeof(pool->colour[0]));
+    pool->count = remaining;
+}
+
+static int random_between(ParticlePool* pool, int min, int max) {
+    // xorshift32, as the games use (see gameRandom)
+    uint32_t x = pool->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    pool->rng = x;
+
+    return min + (int)((x >> 1) % (uint32_t)(max - min + 1));
+}
@@ -0,0 +1,256 @@
+/*
+ * Spawn pattern interpreter; runs scripted waves of blocks (walls with gaps,
+ * zig-zags, bursts and so on) written in patterns/waves.pat.
+ *
+ * The patterns are compiled to a small bytecode by tools/patternc.py when the
+ * firmware is built, and embedded in flash. They're run in place from there;
+ * nothing is copied or allocated per pattern, and the interpreter state is a
+ * handful of registers in the GameState.
+ *
+ * Compiled layout:
+ *     'F' 'B' 'P' version | pattern count | offset of each pattern (2 bytes,
+ *     little endian, from the start of the file) | bytecode
+ *
+ * Instructions (operands are single bytes unless noted):
+ *     end                              the pattern is over
+ *     wait ms (2 bytes)                run nothing more for `ms` ms of game time
+ *     spawn x size speed               spawn a block (x of 255 is random)
+ *     wall gap_x gap_width size speed  a row of blocks across the screen, leaving a gap
+ *     set_x x                          set the x register (255 is random)
+ *     move_x dx (signed)               add to the x register
+ *     spawn_at size speed              spawn a block at the x register
+ *     repeat count                     run up to the matching `loop` `count` times
+ *     loop
+ *
+ * An instruction that can't run yet (a spawn or wall while too many blocks are
+ * still falling) is retried on the next tick, so patterns never lose blocks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pattern.h"
+#include "game.h"
+
+#define FORMAT_VERSION 1
+#define HEADER_SIZE 5
+
+#define OP_END 0
+#define OP_WAIT 1
+#define OP_SPAWN 2
+#define OP_WALL 3
+#define OP_SET_X 4
+#define OP_MOVE_X 5
+#define OP_SPAWN_AT 6
+#define OP_REPEAT 7
+#define OP_LOOP 8
+#define OP_COUNT 9
+
+// An x operand of this picks a random position
+#define RANDOM_X 255
+
+// The result of running an instruction
+typedef enum PatternStep {STEP_CONTINUE, STEP_YIELD} PatternStep;
+
+/* Forward declaration of static methods */
+
+/*
+ * Runs the instruction at the runner's program counter.
+ */
+static PatternStep step(GameState* state);
+
+/*
+ * Starts a new pattern, picked at random from those unlocked by the score.
+ */
+static void start_pattern(GameState* state);
+
+/*
+ * Spawns a row of blocks across the screen, leaving the gap provided. Either
+ * the whole row is spawned or, if too few blocks are free, none of it.
+ *
+ * Returns 1 if the row was spawned.
+ */
+static int spawn_wall(GameState* state, int gap_x, int gap_width, int size, int speed);
+
+/*
+ * Turns an x operand in to a position, picking a random one for RANDOM_X.
+ */
+static int resolve_x(int x);
+
+// The compiled patterns, embedded by the build (see src/CMakeLists.txt)
+extern const uint8_t patterns_start[] asm("_binary_patterns_bin_start");
+extern const uint8_t patterns_end[] asm("_binary_patterns_bin_end");
+
+// The length (including the opcode) of each instruction
+static const uint8_t instruction_length[OP_COUNT] = {1, 3, 4, 5, 2, 2, 3, 2, 1};
+
+static const uint8_t* code = NULL;
+static int code_size = 0;
+static int pattern_count = 0;
+
+/* Method definitions */
+
+void patternInit() {
+    if(!SPAWN_PATTERNS_ENABLED) return;
+
+    const uint8_t* data = patterns_start;
+    int size = patterns_end - patterns_start;
+    if(size < HEADER_SIZE || data[0] != 'F' || data[1] != 'B' || data[2] != 'P' || data[3] != FORMAT_VERSION) {
+        printf("[WARNING] Spawn patterns missing or the wrong version, blocks will spawn at random\n");
+        return;
+    }
+
+    int count = data[4];
+    if(count == 0 || HEADER_SIZE + count * 2 > size) {
+        printf("[WARNING] Spawn pattern table is malformed, blocks will spawn at random\n");
+        return;
+    }
+
+    for(int i = 0; i < count; i++) {
+        int offset = data[HEADER_SIZE + i * 2] | data[HEADER_SIZE + i * 2 + 1] << 8;
+        if(offset < HEADER_SIZE + count * 2 || offset >= size) {
+            printf("[WARNING] Spawn pattern %d is out of bounds, blocks will spawn at random\n", i);
+            return;
+        }
+    }
+
+    code = data;
+    code_size = size;
+    pattern_count = count;
+    printf("Spawn patterns: %d loaded (%d bytes)\n", pattern_count, code_size);
+}
+
+void patternReset(PatternRunner* runner) {
+    *runner = (PatternRunner) {.pattern = -1};
+}
+
+int patternTick(GameState* state, double dt) {
+    if(pattern_count == 0) return 0;
+
+    PatternRunner* r = &state->pattern;
+    if(r->wait > 0) {
+        r->wait -= dt * 1000;
+        if(r->wait > 0) return 1;
+    }
+
+    for(int i = 0; i < PATTERN_STEPS_PER_TICK; i++) {
+        if(r->pattern < 0) start_pattern(state);
+        if(step(state) == STEP_YIELD) break;
+    }
+
+    return 1;
+}
+
+static PatternStep step(GameState* state) {
+    PatternRunner* r = &state->pattern;
+    int op = r->pc < code_size ? code[r->pc] : OP_END;
+
+    // Anything unknown or running off the end of the code finishes the pattern
+    if(op >= OP_COUNT || r->pc + instruction_length[op] > code_size) op = OP_END;
+
+    const uint8_t* operands = code + r->pc + 1;
+    int next = r->pc + instruction_length[op];
+
+    switch(op) {
+        case OP_END:
+            r->pattern = -1;
+            return STEP_CONTINUE;
+        case OP_WAIT:
+            r->wait += (operands[0] | operands[1] << 8) * 1000;
+            r->pc = next;
+            return r->wait > 0 ? STEP_YIELD : STEP_CONTINUE;
+        case OP_SPAWN:
+            if(spawnBlock(state, resolve_x(operands[0]), operands[1] % BLOCK_SIZE_COUNT, operands[2] % BLOCK_SPEED_COUNT) < 0) return STEP_YIELD;
+            break;
+        case OP_WALL:
+            if(!spawn_wall(state, operands[0], operands[1], operands[2] % BLOCK_SIZE_COUNT, operands[3] % BLOCK_SPEED_COUNT)) return STEP_YIELD;
+            break;
+        case OP_SET_X:
+            r->x = operands[0] == RANDOM_X ? gameRandom(state) % state->field_width : operands[0];
+            break;
+        case OP_MOVE_X:
+            // Spawning clamps to the screen too, this just keeps the register from running away
+            r->x += (int8_t)operands[0];
+            if(r->x < 0) r->x = 0;
+            if(r->x > state->field_width) r->x = state->field_width;
+            break;
+        case OP_SPAWN_AT:
+            if(spawnBlock(state, r->x, operands[0] % BLOCK_SIZE_COUNT, operands[1] % BLOCK_SPEED_COUNT) < 0) return STEP_YIELD;
+            break;
+        case OP_REPEAT:
+            if(r->depth == PATTERN_MAX_DEPTH) {
+                r->pattern = -1;
+                return STEP_CONTINUE;
+            }
+
+            r->loop_start[r->depth] = next;
+            r->loop_count[r->depth] = operands[0];
+            r->depth++;
+            break;
+        case OP_LOOP:
+            if(r->depth > 0 && --r->loop_count[r->depth - 1] > 0) {
+                next = r->loop_start[r->depth - 1];
+            } else if(r->depth > 0) {
+                r->depth--;
+            }
+            break;
+    }
+
+    r->pc = next;
+    return STEP_CONTINUE;
+}
+
+static void start_pattern(GameState* state) {
+    int unlocked = 1 + state->player.score / PATTERN_UNLOCK_SCORE;
+    if(unlocked > pattern_count) unlocked = pattern_count;
+
+    PatternRunner* r = &state->pattern;
+    int pattern = gameRandom(state) % unlocked;
+    int32_t wait = r->wait;
+
+    patternReset(r);
+    r->pattern = pattern;
+    r->pc = code[HEADER_SIZE + pattern * 2] | code[HEADER_SIZE + pattern * 2 + 1] << 8;
+    r->wait = wait;
+}
+
+static int spawn_wall(GameState* state, int gap_x, int gap_width, int size, int speed) {
+    const int widths[BLOCK_SIZE_COUNT] = BLOCK_SIZE_WIDTHS;
+    int width = widths[size];
+
+    // Count the blocks needed first, so a wall is never left half built
+    int needed = 0;
+    for(int x = 0; x + width <= state->field_width; x += width) {
+        if(x + width <= gap_x || x >= gap_x + gap_width) needed++;
+    }
+
+    // Only the blocks spawnBlock may use count (see setBlockLimit)
+    int limit = state->block_limit > 0 ? state->block_limit : MAX_BLOCKS;
+    int free = 0;
+    for(int i = 0; i < limit; i++) {
+        free += state->blocks.enabled[i] == 0 || state->blocks.waiting_for_respawn[i] == 1;
+    }
+
+    if(free < needed) return 0;
+
+    // Escape validation may refuse a block; the rest of the wall is then taken back, lanes
+    // and all, to try again later
+    EscapeModel escape = state->escape;
+    int placed = 0;
+    for(int x = 0; x + width <= state->field_width; x += width) {
+        if(x + width > gap_x && x < gap_x + gap_width) continue;
+
+        if(spawnBlock(state, x, size, speed) < 0) {
+            while(placed-- > 0) unspawnBlock(state, speed);
+            state->escape = escape;
+            return 0;
+        }
+
+        placed++;
+    }
+
+    return 1;
+}
+
+static int resolve_x(int x) {
+    return x == RANDOM_X ? -1 : x;
+}
@@ -0,0 +1,209 @@
+/*
+ * Pixel write counters; measure how much fill work each frame does, and how
+ * much of it is wasted drawing over pixels already drawn that frame.
+ *
+ * The project must be configured with -DPIXEL_STATS=ON, which links the
+ * graphics library calls the game makes (`cls`, `draw_rectangle`, `print_xy`
+ * and `flip_frame`) to the wrappers below with `-Wl,--wrap`. Each counts the
+ * pixels the call writes in a per-pixel heatmap of the frame, then hands it to
+ * the real function. Code that writes to the framebuffer itself (sprites, the
+ * stress mode) counts its own writes with pixelStatsRect/pixelStatsPixel.
+ *
+ * The glyph writes of `print_xy` are counted as the pixels the text changed,
+ * which misses any glyph pixel drawn in the colour already underneath it.
+ *
+ * When each frame is finished (flipped, or its flip skipped as nothing changed)
+ * it's folded in to totals of the pixels written, the pixels covered and the
+ * bytes flushed to the display, and printed every PIXEL_STATS_REPORT_INTERVAL
+ * frames.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixelstats.h"
+
+#ifdef PIXEL_STATS
+// The tallest text counted; rows of taller fonts beyond this aren't counted
+#define MAX_TEXT_HEIGHT 32
+
+typedef struct PixelTotals {
+    uint64_t written;
+    uint64_t covered;
+    uint64_t overdrawn;
+    uint64_t flushed;
+} PixelTotals;
+
+/* Forward declaration of static methods */
+
+/*
+ * Allocates the heatmap the first time a write is counted. Returns 0 if there's no memory for it.
+ */
+static int ensure_heatmap();
+
+/*
+ * Folds the heatmap of the frame just drawn in to the totals and clears it, dumping it
+ * first if a dump was asked for.
+ */
+static void end_frame();
+
+/*
+ * Prints the heatmap as a PGM image, in hex, for tools/heatmap.py.
+ */
+static void dump_heatmap();
+
+/*
+ * Prints the averages per frame, then resets the totals.
+ */
+static void report();
+
+// The real functions; --wrap links these to the originals in the graphics library
+void __real_cls(uint16_t colour);
+void __real_draw_rectangle(int x, int y, int width, int height, uint16_t colour);
+void __real_print_xy(const char* text, int x, int y);
+void __real_flip_frame();
+
+// The writes to each pixel this frame, saturating at 255
+static uint8_t* heatmap = NULL;
+
+// The rows under the text being drawn, from before it was drawn
+static uint16_t text_rows[MAX_TEXT_HEIGHT * MAX_DISPLAY_DIMENSION];
+
+static PixelTotals totals;
+static int frames = 0;
+static int dump_requested = 0;
+#endif
+
+/* Method definitions */
+
+#ifdef PIXEL_STATS
+void pixelStatsRect(int x, int y, int width, int height) {
+    if(!ensure_heatmap()) return;
+
+    // Clip to the screen
+    if(x < 0) {
+        width += x;
+        x = 0;
+    }
+    if(y < 0) {
+        height += y;
+        y = 0;
+    }
+    if(x + width > display_width) width = display_width - x;
+    if(y + height > display_height) height = display_height - y;
+
+    for(int row = y; row < y + height; row++) {
+        uint8_t* heat = heatmap + row * display_width + x;
+        for(int col = 0; col < width; col++) {
+            if(heat[col] < 255) heat[col]++;
+        }
+    }
+}
+
+void pixelStatsPixel(int x, int y) {
+    if(!ensure_heatmap() || x < 0 || y < 0 || x >= display_width || y >= display_height) return;
+
+    uint8_t* heat = &heatmap[y * display_width + x];
+    if(*heat < 255) (*heat)++;
+}
+
+void pixelStatsFrameEnd() {
+    end_frame();
+}
+
+void pixelStatsDumpHeatmap() {
+    dump_requested = 1;
+}
+
+void __wrap_cls(uint16_t colour) {
+    pixelStatsRect(0, 0, display_width, display_height);
+    __real_cls(colour);
+}
+
+void __wrap_draw_rectangle(int x, int y, int width, int height, uint16_t colour) {
+    pixelStatsRect(x, y, width, height);
+    __real_draw_rectangle(x, y, width, height, colour);
+}
+
+void __wrap_print_xy(const char* text, int x, int y) {
+    int top = y < 0 ? 0 : y;
+    int rows = getFontHeight();
+    if(rows > MAX_TEXT_HEIGHT) rows = MAX_TEXT_HEIGHT;
+    if(top + rows > display_height) rows = display_height - top;
+
+    // Compare the rows the text covers before and after drawing it
+    uint16_t* under = frame_buffer + top * display_width;
+    if(rows > 0) memcpy(text_rows, under, rows * display_width * sizeof(uint16_t));
+
+    __real_print_xy(text, x, y);
+
+    for(int i = 0; i < rows * display_width; i++) {
+        if(under[i] != text_rows[i]) pixelStatsPixel(i % display_width, top + i / display_width);
+    }
+}
+
+void __wrap_flip_frame() {
+    __real_flip_frame();
+
+    // The whole framebuffer is sent to the display on every flip
+    totals.flushed += display_width * display_height * sizeof(uint16_t);
+    end_frame();
+}
+
+static int ensure_heatmap() {
+    if(heatmap == NULL) heatmap = calloc(display_width * display_height, 1);
+    return heatmap != NULL;
+}
+
+static void end_frame() {
+    if(!ensure_heatmap()) return;
+
+    if(dump_requested) {
+        dump_heatmap();
+        dump_requested = 0;
+    }
+
+    for(int i = 0; i < display_width * display_height; i++) {
+        totals.written += heatmap[i];
+        totals.covered += heatmap[i] > 0;
+        totals.overdrawn += heatmap[i] > 1;
+    }
+    memset(heatmap, 0, display_width * display_height);
+
+    frames++;
+    if(frames == PIXEL_STATS_REPORT_INTERVAL) report();
+}
+
+static void dump_heatmap() {
+    static const char hex[] = "0123456789abcdef";
+    char line[MAX_DISPLAY_DIMENSION * 2 + 1];
+
+    printf("HEATMAP BEGIN %d %d\n", display_width, display_height);
+    for(int row = 0; row < display_height; row++) {
+        const uint8_t* heat = heatmap + row * display_width;
+        for(int col = 0; col < display_width; col++) {
+            line[col * 2] = hex[heat[col] >> 4];
+            line[col * 2 + 1] = hex[heat[col] & 0xF];
+        }
+        line[display_width * 2] = '\0';
+        printf("HEATMAP DATA %s\n", line);
+    }
+    printf("HEATMAP END\n");
+}
+
+static void report() {
+    int screen = display_width * display_height;
+
+    printf("[PIXELS] per frame over %d frames: %llu written (%.2fx the screen), %llu covered, overdraw %.2fx, "
+        "%llu%% of pixels drawn more than once, %llu bytes flushed\n",
+        frames, totals.written / frames, (double)totals.written / frames / screen, totals.covered / frames,
+        totals.covered ? (double)totals.written / totals.covered : 0, totals.overdrawn * 100 / ((uint64_t)screen * frames),
+        totals.flushed / frames);
+
+    totals = (PixelTotals) {0};
+    frames = 0;
+
+    // Dump the next frame along with every report
+    if(PIXEL_STATS_HEATMAP) dump_requested = 1;
+}
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Dynamic frequency scaling driven by frame headroom.
+ *
+ * Most of every frame is spent waiting for the next tick, and the menu screens
+ * and early game need a fraction of what the CPU can do even while drawing.
+ * Power management lets the CPU drop to 80MHz whenever nothing holds a lock
+ * on a higher frequency, so we hold a CPU_FREQ_MAX lock only while working on
+ * a frame. How high "max" is (160 or 240MHz) is then chosen from how much of
+ * the frame budget the recent frames used.
+ */
+#include <esp_pm.h>
+#include <esp32/pm.h>
+#include <esp32/clk.h>
+#include <esp_timer.h>
+#include <stdio.h>
+
+#include "power.h"
+
+// The time (us) available to each frame
+#define FRAME_BUDGET (1000000 / TARGET_FPS)
+
+// How many frames the busy time is averaged over before deciding on the render frequency
+#define WINDOW_FRAMES TARGET_FPS
+
+// How often (in frames) the time spent at each frequency is printed
+#define REPORT_INTERVAL (TARGET_FPS * 10)
+
+#define IDLE_FREQUENCY 80
+
+// The frequencies time is reported against
+typedef enum PowerFrequency {FREQ_80, FREQ_160, FREQ_240, FREQ_COUNT} PowerFrequency;
+
+/* Forward declaration of static methods */
+
+/*
+ * Reconfigures power management to use the render frequency provided (MHz)
+ * while the render lock is held.
+ */
+static void set_render_frequency(int mhz);
+
+/*
+ * Maps the frequency provided (MHz) to the bucket its time is reported in.
+ */
+static PowerFrequency frequency_bucket(int mhz);
+
+static esp_pm_lock_handle_t render_lock;
+static int render_frequency;
+
+static int64_t frame_start = 0;
+static int64_t last_frame_end = 0;
+static PowerFrequency frame_frequency;
+
+// Busy time over the current decision window
+static int64_t window_busy = 0;
+static int window_frames = 0;
+
+// Time (us) spent at each frequency since the last report
+static int64_t time_at[FREQ_COUNT];
+static int frames_since_report = 0;
+
+/* Method definitions */
+
+void powerInit() {
+    if(!POWER_MANAGEMENT_ENABLED) return;
+
+    esp_err_t err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "frame", &render_lock);
+    if(err != ESP_OK) {
+        printf("[WARNING] Unable to create power management lock: %s\n", esp_err_to_name(err));
+        return;
+    }
+
+    // Start at full speed, and only drop once the game has proven it doesn't need it
+    set_render_frequency(240);
+}
+
+void powerFrameBegin() {
+    if(render_lock == NULL) return;
+
+    int64_t now = esp_timer_get_time();
+    if(last_frame_end > 0) {
+        time_at[frequency_bucket(IDLE_FREQUENCY)] += now - last_frame_end;
+    }
+
+    esp_pm_lock_acquire(render_lock);
+
+    frame_start = esp_timer_get_time();
+    frame_frequency = frequency_bucket(esp_clk_cpu_freq() / 1000000);
+}
+
+void powerFrameEnd() {
+    if(render_lock == NULL) return;
+
+    int64_t now = esp_timer_get_time();
+    int64_t busy = now - frame_start;
+    time_at[frame_frequency] += busy;
+
+    esp_pm_lock_release(render_lock);
+    last_frame_end = now;
+
+    window_busy += busy;
+    window_frames++;
+    if(window_frames == WINDOW_FRAMES) {
+        int percent_used = window_busy * 100 / (WINDOW_FRAMES * FRAME_BUDGET);
+        if(render_frequency == 240 && percent_used * 240 / 160 < POWER_LOWER_THRESHOLD) {
+            // The frames would still comfortably fit at 160MHz
+            set_render_frequency(160);
+        } else if(render_frequency == 160 && percent_used > POWER_RAISE_THRESHOLD) {
+            set_render_frequency(240);
+        }
+
+        window_busy = 0;
+        window_frames = 0;
+    }
+
+    frames_since_report++;
+    if(frames_since_report == REPORT_INTERVAL) {
+        int64_t total = time_at[FREQ_80] + time_at[FREQ_160] + time_at[FREQ_240];
+        if(total > 0) {
+            printf("[POWER] 240MHz: %lld%%, 160MHz: %lld%%, 80MHz: %lld%% (rendering at %dMHz)\n",
+                time_at[FREQ_240] * 100 / total, time_at[FREQ_160] * 100 / total,
+                time_at[FREQ_80] * 100 / total, render_frequency);
+        }
+
+        for(int i = 0; i < FREQ_COUNT; i++) time_at[i] = 0;
+        frames_since_report = 0;
+    }
+}
+
+static void set_render_frequency(int mhz) {
+    esp_pm_config_esp32_t config = {
+        .max_freq_mhz = mhz,
+        .min_freq_mhz = IDLE_FREQUENCY,
+        .light_sleep_enable = false
+    };
+
+    esp_err_t err = esp_pm_configure(&config);
+    if(err != ESP_OK) {
+        printf("[WARNING] Unable to configure power management: %s\n", esp_err_to_name(err));
+        return;
+    }
+
+    render_frequency = mhz;
+}
+
+static PowerFrequency frequency_bucket(int mhz) {
+    if(mhz >= 240) return FREQ_240;
+    if(mhz >= 160) return FREQ_160;
+    return FREQ_80;
+}
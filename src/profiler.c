@@ -0,0 +1,165 @@
+/*
+ * Frame profiler; measures the time, cycles, instructions and flash cache miss
+ * stalls spent in each section of a frame.
+ *
+ * Code run from flash goes through the ESP32's instruction cache, and when it
+ * has been evicted the CPU stalls while the cache line is fetched. The Xtensa
+ * performance counters can count exactly those stall cycles, which tells us
+ * which sections suffer from running out of flash (and so whether placing them
+ * in IRAM, see linker/hotpath.lf, is worth the IRAM it costs).
+ */
+#include <freertos/FreeRTOS.h>
+#include <perfmon.h>
+#include <xtensa/hal.h>
+#include <esp_timer.h>
+#include <stdio.h>
+
+#include "profiler.h"
+
+// The performance counters used; the ESP32 has two per core
+#define COUNTER_STALLS 0
+#define COUNTER_INSTRUCTIONS 1
+
+// Time spent in a frame, but outside any section, is counted against this bucket
+#define OTHER_BUCKET PROFILE_SECTION_COUNT
+
+#define MAX_DEPTH 8
+
+typedef struct ProfilerSample {
+    int64_t time;
+    uint32_t cycles;
+    uint32_t stalls;
+    uint32_t instructions;
+} ProfilerSample;
+
+typedef struct ProfilerTotals {
+    int64_t time;
+    uint64_t cycles;
+    uint64_t stalls;
+    uint64_t instructions;
+} ProfilerTotals;
+
+/* Forward declaration of static methods */
+
+/*
+ * Reads the clock and counters in to the sample provided.
+ */
+static void take_sample(ProfilerSample* sample);
+
+/*
+ * Charges everything since the last mark to the bucket provided, and moves the
+ * mark to now.
+ */
+static void charge(int bucket);
+
+static const char* section_names[PROFILE_SECTION_COUNT + 1] = {
+    "tick", "collisions", "render", "streaming", "flip", "other"
+};
+
+static int initialised = 0;
+static int in_frame = 0;
+
+// The core the counters were configured on; sections run on the other core (the second
+// player's game in versus mode) aren't counted
+static int profiled_core = -1;
+
+// The sections currently open, innermost last
+static ProfilerSection stack[MAX_DEPTH];
+static int depth = 0;
+
+static ProfilerSample mark;
+static ProfilerTotals totals[PROFILE_SECTION_COUNT + 1];
+static int frames = 0;
+
+/* Method definitions */
+
+void profilerInit() {
+    if(!PROFILER_ENABLED) return;
+
+    // Count instruction fetch stalls due to a cache miss, and every instruction executed, at all
+    // interrupt levels (so time in ISRs during a section is included, as it is in the timings).
+    xtensa_perfmon_init(COUNTER_STALLS, XTPERF_CNT_I_STALL, XTPERF_MASK_I_STALL_ICM, 0, -1);
+    xtensa_perfmon_init(COUNTER_INSTRUCTIONS, XTPERF_CNT_INSN, XTPERF_MASK_INSN_ALL, 0, -1);
+    xtensa_perfmon_reset(COUNTER_STALLS);
+    xtensa_perfmon_reset(COUNTER_INSTRUCTIONS);
+    xtensa_perfmon_start();
+
+    profiled_core = xPortGetCoreID();
+    initialised = 1;
+}
+
+void profilerFrameBegin() {
+    if(!initialised) return;
+
+    depth = 0;
+    in_frame = 1;
+    take_sample(&mark);
+}
+
+void profilerFrameEnd() {
+    if(!in_frame) return;
+
+    charge(depth > 0 ? stack[depth - 1] : OTHER_BUCKET);
+    in_frame = 0;
+
+    frames++;
+    if(frames == PROFILER_REPORT_INTERVAL) profilerReport();
+}
+
+void profilerBegin(ProfilerSection section) {
+    if(!in_frame || depth == MAX_DEPTH || xPortGetCoreID() != profiled_core) return;
+
+    charge(depth > 0 ? stack[depth - 1] : OTHER_BUCKET);
+    stack[depth++] = section;
+}
+
+void profilerEnd(ProfilerSection section) {
+    if(!in_frame || depth == 0 || stack[depth - 1] != section || xPortGetCoreID() != profiled_core) return;
+
+    charge(section);
+    depth--;
+}
+
+void profilerReport() {
+    if(frames == 0) return;
+
+#ifdef HOT_PATH_IN_IRAM
+    const char* placement = "IRAM";
+#else
+    const char* placement = "flash";
+#endif
+
+    printf("[PROFILER] hot path in %s, averages per frame over %d frames:\n", placement, frames);
+    for(int i = 0; i <= PROFILE_SECTION_COUNT; i++) {
+        ProfilerTotals* t = &totals[i];
+        if(t->cycles == 0) continue;
+
+        printf("[PROFILER] %-10s %6lldus %8llu cycles %7llu stall cycles (%2llu%%) IPC %.2f\n",
+            section_names[i], t->time / frames, t->cycles / frames, t->stalls / frames,
+            t->stalls * 100 / t->cycles, (double)t->instructions / t->cycles);
+
+        *t = (ProfilerTotals) {0};
+    }
+
+    frames = 0;
+}
+
+static void take_sample(ProfilerSample* sample) {
+    sample->time = esp_timer_get_time();
+    sample->cycles = xthal_get_ccount();
+    sample->stalls = xtensa_perfmon_value(COUNTER_STALLS);
+    sample->instructions = xtensa_perfmon_value(COUNTER_INSTRUCTIONS);
+}
+
+static void charge(int bucket) {
+    ProfilerSample now;
+    take_sample(&now);
+
+    // The counters are 32 bits and wrap; unsigned differences are still correct
+    totals[bucket].time += now.time - mark.time;
+    totals[bucket].cycles += (uint32_t)(now.cycles - mark.cycles);
+    totals[bucket].stalls += (uint32_t)(now.stalls - mark.stalls);
+    totals[bucket].instructions += (uint32_t)(now.instructions - mark.instructions);
+
+    mark = now;
+}
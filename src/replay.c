@@ -0,0 +1,512 @@
+/*
+ * Replay recorder; records the inputs (and tick timings) of every game to the
+ * `replay` flash partition, so any game played can be re-run exactly.
+ *
+ * The game loop only ever appends events to a RAM ring buffer. A low priority
+ * task drains that buffer a sector at a time and writes it to flash, so the game
+ * loop never waits for an erase or write itself.
+ *
+ * That isn't enough on its own; a sector erase (around 45ms) disables the flash
+ * cache and parks the other core for as long as it takes, whichever task asked
+ * for it. So sectors are only erased between games: the writer keeps
+ * REPLAY_ERASE_AHEAD sectors erased ahead of it while nothing is being played,
+ * and during a game only writes in to those (a write parks the other core for
+ * well under a millisecond at a time). A game that outgrows them waits in the
+ * ring buffer until it ends, and is truncated if that fills first.
+ *
+ * Sectors are written in order around the whole partition, overwriting the
+ * oldest recording, which spreads erases evenly over every sector (wear
+ * levelling). Each sector starts with a small header naming the game, the
+ * chunk of the game it holds and a sequence number; the index of recent games
+ * is rebuilt from these headers at boot, so no separate index has to be kept
+ * (and worn out) in flash.
+ *
+ * Events are varints of (value << 2 | tag):
+ *     tag 0: tick, value is the zigzag of dt minus the nominal tick length (us)
+ *     tag 1: input, value is the direction; from INPUT_BLOCK_LIMIT up, the
+ *            block limit (plus INPUT_BLOCK_LIMIT) set from the console
+ *     tag 2: game start, value is the random seed
+ *     tag 3: game end, value is the final score
+ *
+ * A block limit the game starts with is recorded just before its start event,
+ * so a re-run sets it before the blocks are first enabled.
+ */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/stream_buffer.h>
+#include <esp_partition.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "replay.h"
+
+#define SECTOR_SIZE 4096
+#define SECTOR_MAGIC 0x52504C59
+
+// The tags match the ReplayEventType each is read back as
+#define TAG_TICK REPLAY_TICK
+#define TAG_INPUT REPLAY_INPUT
+#define TAG_START REPLAY_START
+#define TAG_END REPLAY_END
+
+// Input values from here on are block limits rather than directions
+#define INPUT_BLOCK_LIMIT 8
+
+// The tick length the recorded dt values are relative to
+#define NOMINAL_DT (1000000 / TARGET_FPS)
+
+// The header at the start of every written sector
+typedef struct ReplaySectorHeader {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t game_id;
+    uint16_t chunk;
+    uint16_t length;
+
+    // The final score, only set in the last chunk of a game (-1 otherwise)
+    int32_t score;
+} ReplaySectorHeader;
+
+#define SECTOR_PAYLOAD (SECTOR_SIZE - sizeof(ReplaySectorHeader))
+
+// Sent from the game loop to the writer when a game ends
+typedef struct ReplayGameEnd {
+    uint32_t length;
+    int score;
+} ReplayGameEnd;
+
+/* Forward declaration of static methods */
+
+/*
+ * The body of the low priority task that writes recorded events to flash.
+ */
+static void replay_writer_task(void* arg);
+
+/*
+ * Writes the sector buffer (header and `length` bytes of payload) to the next
+ * sector, which must already be erased.
+ */
+static void write_sector(uint32_t game_id, int chunk, int length, int score);
+
+/*
+ * Erases the first sector past those already erased ahead of the writer.
+ */
+static void erase_ahead();
+
+/*
+ * Scans the headers of every sector to find where to write next, and which
+ * recent games are still in the partition.
+ */
+static void rebuild_index();
+
+/*
+ * Adds (or updates) a game in the index of recent games, keeping it sorted newest first.
+ */
+static void index_game(uint32_t game_id, int sector, int chunk, int length, int score);
+
+/*
+ * Looks up the recent game at the position provided, copying its index entry.
+ *
+ * Returns 0 if there's no such game.
+ */
+static int find_game(int position, ReplayIndexEntry* entry);
+
+/*
+ * Appends an event to the ring buffer. If it doesn't fit, the writer has fallen
+ * too far behind and the rest of the game isn't recorded.
+ */
+static void record_event(int tag, uint64_t value);
+
+static const esp_partition_t* partition;
+static int sector_count;
+
+// Where the next sector is written, and the sequence number it will be given
+static int next_sector;
+static uint32_t next_sequence;
+static uint32_t next_game_id;
+
+// The amount of sectors from `next_sector` on that are erased, ready to be written during a game
+static int erased_ahead;
+
+// Set from the start of a game to its end, whether or not it's being recorded; no sector is erased meanwhile
+static volatile int in_game;
+
+// Events waiting to be written to flash, and the games that have finished
+static StreamBufferHandle_t pending_events;
+static QueueHandle_t game_ends;
+
+// The amount of games handed to the writer, and the amount it has finished writing (see replayFlush)
+static uint32_t games_ended;
+static volatile uint32_t games_written;
+
+// Cleared to stop recording games (see replaySetEnabled)
+static int enabled = 1;
+
+// The game loop's view of the game being recorded
+static int recording;
+static uint32_t game_length;
+
+// The sector being assembled by the writer task
+static uint8_t sector_buffer[SECTOR_SIZE];
+
+// Recent games, newest first. Guarded by `index_lock` as the writer task adds to it.
+static ReplayIndexEntry recent_games[REPLAY_INDEX_SIZE];
+static int recent_game_count;
+static portMUX_TYPE index_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Method definitions */
+
+void replayInit() {
+    if(!REPLAY_ENABLED) return;
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, 0x40, "replay");
+    if(partition == NULL) {
+        printf("[WARNING] No replay partition found, games will not be recorded\n");
+        return;
+    }
+
+    sector_count = partition->size / SECTOR_SIZE;
+    rebuild_index();
+
+    pending_events = xStreamBufferCreate(REPLAY_BUFFER_SIZE, 1);
+    game_ends = xQueueCreate(4, sizeof(ReplayGameEnd));
+    xTaskCreate(replay_writer_task, "Replay", 2048, NULL, tskIDLE_PRIORITY + 1, NULL);
+
+    printf("Replay: %d sectors, %d recent games, next game #%u\n", sector_count, recent_game_count, next_game_id);
+}
+
+void replayBeginGame(uint32_t seed, int block_limit) {
+    if(partition == NULL) return;
+
+    in_game = 1;
+    if(!enabled) return;
+
+    recording = 1;
+    game_length = 0;
+    if(block_limit > 0) record_event(TAG_INPUT, INPUT_BLOCK_LIMIT + block_limit);
+    record_event(TAG_START, seed);
+}
+
+void replayRecordTick(int dt) {
+    int32_t deviation = dt - NOMINAL_DT;
+    record_event(TAG_TICK, ((uint32_t)deviation << 1) ^ (uint32_t)(deviation >> 31));
+}
+
+void replayRecordInput(int direction) {
+    record_event(TAG_INPUT, direction);
+}
+
+void replayRecordBlockLimit(int block_limit) {
+    record_event(TAG_INPUT, INPUT_BLOCK_LIMIT + block_limit);
+}
+
+void replayEndGame(int score) {
+    in_game = 0;
+    if(partition == NULL || game_length == 0) return;
+
+    // A truncated recording doesn't get an end event; the index shows it as incomplete
+    if(recording) record_event(TAG_END, score);
+
+    ReplayGameEnd end = {
+        .length = game_length,
+        .score = recording ? score : -1
+    };
+
+    recording = 0;
+    game_length = 0;
+    if(xQueueSend(game_ends, &end, 0) == pdTRUE) games_ended++;
+}
+
+int replayFlush(int timeout) {
+    if(partition == NULL) return 1;
+
+    // Whatever was recorded of the current game is kept, as an incomplete recording
+    recording = 0;
+    replayEndGame(-1);
+
+    for(int waited = 0; games_written != games_ended; waited += 10) {
+        if(waited >= timeout) return 0;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    return 1;
+}
+
+void replaySetEnabled(int enable) {
+    enabled = enable;
+
+    // Stopping part way through a game leaves its recording incomplete, as if the buffer had filled
+    if(!enabled) recording = 0;
+}
+
+int replayRecentGames(ReplayIndexEntry* entries, int max) {
+    portENTER_CRITICAL(&index_lock);
+    int count = recent_game_count < max ? recent_game_count : max;
+    memcpy(entries, recent_games, count * sizeof(ReplayIndexEntry));
+    portEXIT_CRITICAL(&index_lock);
+
+    return count;
+}
+
+void replayDump(int position) {
+    ReplayIndexEntry entry;
+    if(!find_game(position, &entry)) return;
+
+    printf("REPLAY BEGIN %u %d %d\n", entry.game_id, entry.length, entry.score);
+    for(int chunk = 0; chunk < entry.chunks; chunk++) {
+        int sector = (entry.first_sector + chunk) % sector_count;
+        ReplaySectorHeader header;
+        esp_partition_read(partition, sector * SECTOR_SIZE, &header, sizeof(header));
+
+        // The game has been overwritten since the index was built
+        if(header.magic != SECTOR_MAGIC || header.game_id != entry.game_id) break;
+
+        uint8_t line[32];
+        for(int offset = 0; offset < header.length; offset += sizeof(line)) {
+            int length = header.length - offset < sizeof(line) ? header.length - offset : sizeof(line);
+            esp_partition_read(partition, sector * SECTOR_SIZE + sizeof(header) + offset, line, length);
+
+            printf("REPLAY DATA ");
+            for(int i = 0; i < length; i++) printf("%02x", line[i]);
+            printf("\n");
+        }
+    }
+    printf("REPLAY END %u\n", entry.game_id);
+}
+
+int replayRead(int position, ReplayEventCallback callback, void* arg) {
+    ReplayIndexEntry entry;
+    if(!find_game(position, &entry)) return 0;
+
+    // Varints may be split across sectors, so the decoder carries on from one read to the next
+    uint64_t value = 0;
+    int shift = 0;
+    for(int chunk = 0; chunk < entry.chunks; chunk++) {
+        int sector = (entry.first_sector + chunk) % sector_count;
+        ReplaySectorHeader header;
+        esp_partition_read(partition, sector * SECTOR_SIZE, &header, sizeof(header));
+
+        // The game has been overwritten since the index was built
+        if(header.magic != SECTOR_MAGIC || header.game_id != entry.game_id) break;
+
+        uint8_t block[64];
+        for(int offset = 0; offset < header.length; offset += sizeof(block)) {
+            int length = header.length - offset < sizeof(block) ? header.length - offset : sizeof(block);
+            esp_partition_read(partition, sector * SECTOR_SIZE + sizeof(header) + offset, block, length);
+
+            for(int i = 0; i < length; i++) {
+                value |= (uint64_t)(block[i] & 0x7F) << shift;
+                shift += 7;
+                if(block[i] & 0x80) continue;
+
+                int tag = value & 0x3;
+                uint32_t event = value >> 2;
+                if(tag == TAG_TICK) event = NOMINAL_DT + (int32_t)((event >> 1) ^ -(event & 1));
+                if(tag == TAG_INPUT && event >= INPUT_BLOCK_LIMIT) {
+                    tag = REPLAY_BLOCK_LIMIT;
+                    event -= INPUT_BLOCK_LIMIT;
+                }
+
+                callback(tag, event, arg);
+                value = 0;
+                shift = 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+static int find_game(int position, ReplayIndexEntry* entry) {
+    if(partition == NULL) return 0;
+
+    portENTER_CRITICAL(&index_lock);
+    int found = position >= 0 && position < recent_game_count;
+    if(found) *entry = recent_games[position];
+    portEXIT_CRITICAL(&index_lock);
+
+    return found;
+}
+
+static void record_event(int tag, uint64_t value) {
+    if(!recording) return;
+
+    uint8_t encoded[10];
+    int length = 0;
+    value = (value << 2) | tag;
+    do {
+        encoded[length] = value & 0x7F;
+        value >>= 7;
+        if(value) encoded[length] |= 0x80;
+        length++;
+    } while(value);
+
+    if(xStreamBufferSpacesAvailable(pending_events) < length) {
+        recording = 0;
+        printf("[WARNING] Replay buffer full, the rest of this game will not be recorded\n");
+        return;
+    }
+
+    xStreamBufferSend(pending_events, encoded, length, 0);
+    game_length += length;
+}
+
+static void replay_writer_task(void* arg) {
+    uint8_t* payload = sector_buffer + sizeof(ReplaySectorHeader);
+    int fill = 0;
+    int chunk = 0;
+    int first_sector = next_sector;
+    uint32_t consumed = 0;
+
+    ReplayGameEnd end;
+    int end_known = 0;
+    while(1) {
+        if(!end_known) end_known = xQueueReceive(game_ends, &end, 0) == pdTRUE;
+
+        // Between games, with nothing left to write, get sectors erased ready for the next game
+        if(!in_game && !end_known && erased_ahead < REPLAY_ERASE_AHEAD && xStreamBufferIsEmpty(pending_events)) {
+            erase_ahead();
+            continue;
+        }
+
+        // Never read past the end of the current game; the rest belongs to the next one
+        size_t wanted = SECTOR_PAYLOAD - fill;
+        if(end_known && end.length - consumed < wanted) wanted = end.length - consumed;
+
+        if(wanted > 0) {
+            size_t received = xStreamBufferReceive(pending_events, payload + fill, wanted, pdMS_TO_TICKS(100));
+            fill += received;
+            consumed += received;
+        }
+
+        int game_done = end_known && consumed == end.length;
+        if(fill < SECTOR_PAYLOAD && !game_done) continue;
+
+        // Out of erased sectors; the events wait in the ring buffer until the game is over
+        if(erased_ahead == 0) {
+            if(in_game) {
+                vTaskDelay(pdMS_TO_TICKS(100));
+                continue;
+            }
+
+            erase_ahead();
+        }
+
+        if(chunk == 0) first_sector = next_sector;
+        write_sector(next_game_id, chunk, fill, game_done ? end.score : -1);
+        index_game(next_game_id, first_sector, chunk, consumed, game_done ? end.score : -1);
+
+        fill = 0;
+        chunk++;
+        if(game_done) {
+            games_written++;
+            next_game_id++;
+            chunk = 0;
+            consumed = 0;
+            end_known = 0;
+        }
+    }
+}
+
+static void write_sector(uint32_t game_id, int chunk, int length, int score) {
+    ReplaySectorHeader header = {
+        .magic = SECTOR_MAGIC,
+        .sequence = next_sequence++,
+        .game_id = game_id,
+        .chunk = chunk,
+        .length = length,
+        .score = score
+    };
+    memcpy(sector_buffer, &header, sizeof(header));
+
+    esp_partition_write(partition, next_sector * SECTOR_SIZE, sector_buffer, sizeof(header) + length);
+
+    next_sector = (next_sector + 1) % sector_count;
+    erased_ahead--;
+}
+
+static void erase_ahead() {
+    if(erased_ahead >= sector_count) return;
+
+    int sector = (next_sector + erased_ahead) % sector_count;
+    esp_partition_erase_range(partition, sector * SECTOR_SIZE, SECTOR_SIZE);
+    erased_ahead++;
+}
+
+static void rebuild_index() {
+    uint32_t newest_sequence = 0;
+    int found = 0;
+    next_sector = 0;
+    next_game_id = 0;
+
+    for(int sector = 0; sector < sector_count; sector++) {
+        ReplaySectorHeader header;
+        esp_partition_read(partition, sector * SECTOR_SIZE, &header, sizeof(header));
+        if(header.magic != SECTOR_MAGIC) continue;
+
+        if(!found || header.sequence > newest_sequence) {
+            newest_sequence = header.sequence;
+            next_sector = (sector + 1) % sector_count;
+        }
+
+        if(header.game_id >= next_game_id) next_game_id = header.game_id + 1;
+        found = 1;
+    }
+
+    next_sequence = found ? newest_sequence + 1 : 0;
+
+    // Now the newest game is known, pick out the chunks of the recent ones. Only
+    // games whose first chunk survives are indexed; older ones are partly overwritten.
+    for(int sector = 0; sector < sector_count; sector++) {
+        ReplaySectorHeader header;
+        esp_partition_read(partition, sector * SECTOR_SIZE, &header, sizeof(header));
+        if(header.magic != SECTOR_MAGIC || header.chunk != 0) continue;
+        if(next_game_id - header.game_id > REPLAY_INDEX_SIZE) continue;
+
+        int chunk = 0;
+        int length = 0;
+        int score = -1;
+        while(chunk < sector_count) {
+            ReplaySectorHeader chunk_header;
+            esp_partition_read(partition, ((sector + chunk) % sector_count) * SECTOR_SIZE, &chunk_header, sizeof(chunk_header));
+            if(chunk_header.magic != SECTOR_MAGIC || chunk_header.game_id != header.game_id || chunk_header.chunk != chunk) break;
+
+            length += chunk_header.length;
+            score = chunk_header.score;
+            chunk++;
+        }
+
+        index_game(header.game_id, sector, chunk - 1, length, score);
+    }
+}
+
+static void index_game(uint32_t game_id, int sector, int chunk, int length, int score) {
+    portENTER_CRITICAL(&index_lock);
+
+    int position = 0;
+    while(position < recent_game_count && recent_games[position].game_id > game_id) position++;
+
+    if(position == recent_game_count || recent_games[position].game_id != game_id) {
+        // A new game; make room for it, dropping the oldest game if the index is full
+        if(position >= REPLAY_INDEX_SIZE) {
+            portEXIT_CRITICAL(&index_lock);
+            return;
+        }
+
+        int moved = recent_game_count - position;
+        if(recent_game_count == REPLAY_INDEX_SIZE) moved--;
+        memmove(&recent_games[position + 1], &recent_games[position], moved * sizeof(ReplayIndexEntry));
+        if(recent_game_count < REPLAY_INDEX_SIZE) recent_game_count++;
+    }
+
+    recent_games[position] = (ReplayIndexEntry) {
+        .game_id = game_id,
+        .first_sector = sector,
+        .chunks = chunk + 1,
+        .length = length,
+        .score = score
+    };
+
+    portEXIT_CRITICAL(&index_lock);
+}
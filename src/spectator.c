@@ -0,0 +1,351 @@
+/*
+ * Spectator stream; sends the changes to the game state each tick over UART so
+ * the game can be watched live on a host (see tools/spectator.py).
+ *
+ * Sending whole frames (135x240 pixels, 16 bits each) is impossible at serial
+ * speeds, so instead we send the game state itself, and only what has changed
+ * since the last frame. Each frame is a bit-packed stream of small varints:
+ * on a typical tick only the common block fall distance and the odd player
+ * movement change, which is only a few bytes.
+ *
+ * Frame layout on the wire:
+ *     0xA5 0x5A | payload length (2 bytes, little endian) | payload | CRC-8
+ *
+ * Payload (bit stream, least significant bit first):
+ *     keyframe flag (1 bit)
+ *     keyframe: tick, phase, block count, player x/y, score, velocity,
+ *               visible block mask and the x/y/size of every visible block
+ *     delta:    tick increment, then for each of phase, player x, score,
+ *               velocity and blocks a 'changed' bit followed by the change
+ */
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/stream_buffer.h>
+#include <driver/uart.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "spectator.h"
+
+#define SYNC_BYTE_0 0xA5
+#define SYNC_BYTE_1 0x5A
+
+// Frame header (sync + length) and trailer (CRC) sizes in bytes
+#define FRAME_OVERHEAD 5
+
+// Largest payload we'll ever produce; every block visible in a keyframe with
+// worst case varints, plus the fixed fields.
+#define MAX_PAYLOAD (16 + MAX_BLOCKS * 10)
+
+// A block is visible to spectators only when it's on screen
+#define BLOCK_VISIBLE(blocks, i) ((blocks)->enabled[i] && !(blocks)->waiting_for_respawn[i])
+
+// Visible blocks are tracked as bits in a single word
+#if MAX_BLOCKS > 32
+#error "The spectator stream supports at most 32 blocks"
+#endif
+
+/*
+ * Writes bits in to a byte buffer, least significant bit first.
+ */
+typedef struct BitWriter {
+    uint8_t* buffer;
+    int bit_pos;
+} BitWriter;
+
+/*
+ * The state last sent to spectators; the next delta is encoded against this.
+ */
+typedef struct SpectatorSnapshot {
+    GameStatePhase phase;
+    int player_x;
+    int player_y;
+    int score;
+    int velocity;
+    uint32_t visible;
+    int block_x[MAX_BLOCKS];
+    int block_y[MAX_BLOCKS];
+} SpectatorSnapshot;
+
+/* Forward declaration of static methods */
+
+/*
+ * The body of the low priority task that drains the stream buffer in to the UART.
+ */
+static void spectator_task(void* arg);
+
+/*
+ * Appends the lowest `count` bits of `value` to the bit stream.
+ */
+static void put_bits(BitWriter* w, uint32_t value, int count);
+
+/*
+ * Appends an unsigned varint to the bit stream. Varints are written in groups of
+ * four bits (three bits of value and a continuation bit) as most of the numbers
+ * we send (fall distances, movement) are very small.
+ */
+static void put_varint(BitWriter* w, uint32_t value);
+
+/*
+ * Appends a signed varint, zigzag encoded so small negatives stay small.
+ */
+static void put_svarint(BitWriter* w, int32_t value);
+
+/*
+ * Encodes a full keyframe of the state provided.
+ */
+static void encode_keyframe(BitWriter* w, const GameState* state, uint32_t visible);
+
+/*
+ * Encodes the changes between the last snapshot and the state provided.
+ */
+static void encode_delta(BitWriter* w, const GameState* state, uint32_t visible, uint32_t ticks);
+
+/*
+ * Stores the state provided as the snapshot the next delta is encoded against.
+ */
+static void take_snapshot(const GameState* state, uint32_t visible);
+
+/*
+ * CRC-8 (polynomial 0x07) of the buffer provided, used by the decoder to reject
+ * frames that were corrupted or interleaved with console output.
+ */
+static uint8_t crc8(const uint8_t* data, int length);
+
+// Encoded frames waiting to be sent to the UART by the spectator task
+static StreamBufferHandle_t pending_frames;
+
+// The last state sent to spectators
+static SpectatorSnapshot last;
+
+// The current tick, and the tick the last frame was sent on
+static uint32_t tick = 0;
+static uint32_t last_sent_tick = 0;
+
+// Set when the next frame must be a keyframe (first frame, or after a drop)
+static int keyframe_pending = 1;
+
+/* Method definitions */
+
+void spectatorInit() {
+    if(!SPECTATOR_ENABLED) return;
+
+    // A TX ring buffer lets uart_write_bytes return as soon as the frame is copied,
+    // the stream buffer in front of it is what keeps the game loop from ever blocking.
+    uart_driver_install(SPECTATOR_UART_NUM, 256, SPECTATOR_BUFFER_SIZE, 0, NULL, 0);
+
+    pending_frames = xStreamBufferCreate(SPECTATOR_BUFFER_SIZE, 1);
+    xTaskCreate(spectator_task, "Spectator", 2048, NULL, tskIDLE_PRIORITY + 1, NULL);
+}
+
+void spectatorEmit(const GameState* state) {
+    if(!SPECTATOR_ENABLED) return;
+
+    tick++;
+
+    // Compute the visible block mask once; both encoders need it
+    uint32_t visible = 0;
+    for(int i = 0; i < MAX_BLOCKS; i++) {
+        if(BLOCK_VISIBLE(&state->blocks, i)) visible |= 1u << i;
+    }
+
+    // The player only ever moves sideways; anything else means we need a keyframe
+    int keyframe = keyframe_pending
+        || tick - last_sent_tick >= SPECTATOR_KEYFRAME_INTERVAL
+        || state->player.y != last.player_y;
+
+    uint8_t frame[MAX_PAYLOAD + FRAME_OVERHEAD];
+    uint8_t* payload = frame + 4;
+    memset(payload, 0, MAX_PAYLOAD);
+
+    BitWriter w = {.buffer = payload, .bit_pos = 0};
+    put_bits(&w, keyframe, 1);
+    if(keyframe) {
+        encode_keyframe(&w, state, visible);
+    } else {
+        encode_delta(&w, state, visible, tick - last_sent_tick);
+    }
+
+    int length = (w.bit_pos + 7) / 8;
+    frame[0] = SYNC_BYTE_0;
+    frame[1] = SYNC_BYTE_1;
+    frame[2] = length & 0xFF;
+    frame[3] = length >> 8;
+    payload[length] = crc8(payload, length);
+
+    int frame_length = length + FRAME_OVERHEAD;
+    if(xStreamBufferSpacesAvailable(pending_frames) < frame_length) {
+        // Spectators would desync on the next delta, so resync them with a keyframe
+        // once the UART has caught up.
+        keyframe_pending = 1;
+        return;
+    }
+
+    xStreamBufferSend(pending_frames, frame, frame_length, 0);
+    take_snapshot(state, visible);
+    last_sent_tick = tick;
+    keyframe_pending = 0;
+}
+
+static void spectator_task(void* arg) {
+    uint8_t chunk[128];
+    while(1) {
+        size_t received = xStreamBufferReceive(pending_frames, chunk, sizeof(chunk), portMAX_DELAY);
+        if(received > 0) {
+            uart_write_bytes(SPECTATOR_UART_NUM, (const char*)chunk, received);
+        }
+    }
+}
+
+static void encode_keyframe(BitWriter* w, const GameState* state, uint32_t visible) {
+    put_varint(w, tick);
+    put_bits(w, state->phase, 2);
+    put_varint(w, MAX_BLOCKS);
+    put_varint(w, state->player.x);
+    put_varint(w, state->player.y);
+    put_varint(w, state->player.score);
+    put_varint(w, state->velocity);
+    put_bits(w, visible, MAX_BLOCKS);
+
+    for(int i = 0; i < MAX_BLOCKS; i++) {
+        if(visible & (1u << i)) {
+            put_varint(w, state->blocks.x[i]);
+            put_svarint(w, BLOCK_Y(&state->blocks, i));
+            put_varint(w, state->blocks.width[i]);
+            put_varint(w, state->blocks.height[i]);
+        }
+    }
+}
+
+static void encode_delta(BitWriter* w, const GameState* state, uint32_t visible, uint32_t ticks) {
+    // Usually 1, so write it less one to fit in a single group
+    put_varint(w, ticks - 1);
+
+    int phase_changed = state->phase != last.phase;
+    put_bits(w, phase_changed, 1);
+    if(phase_changed) put_bits(w, state->phase, 2);
+
+    int x_changed = state->player.x != last.player_x;
+    put_bits(w, x_changed, 1);
+    if(x_changed) put_svarint(w, state->player.x - last.player_x);
+
+    int score_changed = state->player.score != last.score;
+    put_bits(w, score_changed, 1);
+    if(score_changed) put_svarint(w, state->player.score - last.score);
+
+    int velocity_changed = state->velocity != last.velocity;
+    put_bits(w, velocity_changed, 1);
+    if(velocity_changed) put_svarint(w, state->velocity - last.velocity);
+
+    // Blocks that are visible now and were last frame simply fall; anything
+    // appearing is sent in full, anything disappearing only needs its bit toggled.
+    uint32_t persisting = visible & last.visible;
+    uint32_t spawned = visible & ~last.visible;
+    int blocks_changed = visible != last.visible;
+    for(int i = 0; i < MAX_BLOCKS && !blocks_changed; i++) {
+        if(persisting & (1u << i)) {
+            blocks_changed = BLOCK_Y(&state->blocks, i) != last.block_y[i] || state->blocks.x[i] != last.block_x[i];
+        }
+    }
+
+    put_bits(w, blocks_changed, 1);
+    if(!blocks_changed) return;
+
+    put_bits(w, visible ^ last.visible, MAX_BLOCKS);
+    for(int i = 0; i < MAX_BLOCKS; i++) {
+        if(spawned & (1u << i)) {
+            put_varint(w, state->blocks.x[i]);
+            put_svarint(w, BLOCK_Y(&state->blocks, i));
+            put_varint(w, state->blocks.width[i]);
+            put_varint(w, state->blocks.height[i]);
+        }
+    }
+
+    if(persisting == 0) return;
+
+    // Take the fall distance of the first persisting block as the common distance, and
+    // only spell out the blocks that differ from it (there usually aren't any).
+    int common_dy = 0;
+    int exceptions = 0;
+    int x_moved = 0;
+    int first = 1;
+    for(int i = 0; i < MAX_BLOCKS; i++) {
+        if(!(persisting & (1u << i))) continue;
+
+        int dy = BLOCK_Y(&state->blocks, i) - last.block_y[i];
+        if(first) {
+            common_dy = dy;
+            first = 0;
+        } else if(dy != common_dy) {
+            exceptions = 1;
+        }
+
+        x_moved |= state->blocks.x[i] != last.block_x[i];
+    }
+
+    put_svarint(w, common_dy);
+    put_bits(w, exceptions, 1);
+    put_bits(w, x_moved, 1);
+    for(int i = 0; i < MAX_BLOCKS; i++) {
+        if(!(persisting & (1u << i))) continue;
+
+        if(exceptions) {
+            int dy = BLOCK_Y(&state->blocks, i) - last.block_y[i];
+            put_bits(w, dy != common_dy, 1);
+            if(dy != common_dy) put_svarint(w, dy);
+        }
+
+        if(x_moved) {
+            int dx = state->blocks.x[i] - last.block_x[i];
+            put_bits(w, dx != 0, 1);
+            if(dx != 0) put_svarint(w, dx);
+        }
+    }
+}
+
+static void take_snapshot(const GameState* state, uint32_t visible) {
+    last.phase = state->phase;
+    last.player_x = state->player.x;
+    last.player_y = state->player.y;
+    last.score = state->player.score;
+    last.velocity = state->velocity;
+    last.visible = visible;
+
+    for(int i = 0; i < MAX_BLOCKS; i++) {
+        last.block_x[i] = state->blocks.x[i];
+        last.block_y[i] = BLOCK_Y(&state->blocks, i);
+    }
+}
+
+static void put_bits(BitWriter* w, uint32_t value, int count) {
+    for(int i = 0; i < count; i++) {
+        if(value & (1u << i)) {
+            w->buffer[w->bit_pos >> 3] |= 1u << (w->bit_pos & 7);
+        }
+        w->bit_pos++;
+    }
+}
+
+static void put_varint(BitWriter* w, uint32_t value) {
+    do {
+        uint32_t group = value & 0x7;
+        value >>= 3;
+        put_bits(w, group | (value ? 0x8 : 0), 4);
+    } while(value);
+}
+
+static void put_svarint(BitWriter* w, int32_t value) {
+    put_varint(w, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static uint8_t crc8(const uint8_t* data, int length) {
+    uint8_t crc = 0;
+    for(int i = 0; i < length; i++) {
+        crc ^= data[i];
+        for(int bit = 0; bit < 8; bit++) {
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+
+    return crc;
+}
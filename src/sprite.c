@@ -0,0 +1,238 @@
+/*
+ * Sprite masks; the shapes of the player and blocks, for pixel accurate
+ * collisions and drawing.
+ *
+ * Every row of a sprite is a single word, so testing two sprites is a
+ * bounding box check followed by, for each row they share, shifting one row
+ * in line with the other and ANDing them; a handful of word operations rather
+ * than a test per pixel.
+ *
+ * Drawing a sprite that's wholly inside the screen (and band) uses kernels
+ * generated at build time for its exact size (sprite_kernels.h, from the art
+ * below; see tools/gen_fill_kernels.py), fully unrolled stores with no mask or
+ * bounds tests. Sprites crossing an edge take the generic clipped path.
+ */
+#include "sprite.h"
+#include "pixelstats.h"
+
+#define PIXEL 'X'
+
+// The per-pixel write counters need every pixel drawn to go through the generic path
+#ifdef PIXEL_STATS
+#define BLIT_KERNELS 0
+#else
+#define BLIT_KERNELS 1
+#endif
+
+/* Forward declaration of static methods */
+
+/*
+ * Packs pixel art (one string per row, PIXEL for a set pixel) in to the mask provided.
+ */
+static void build_mask(SpriteMask* mask, const char* const* art, int height);
+
+// The pixel art of each sprite. The block sizes must match BLOCK_SIZE_WIDTHS/HEIGHTS in core.h.
+static const char* const player_art[PLAYER_HEIGHT] = {
+    ".........XX.........",
+    "........XXXX........",
+    "........XXXX........",
+    ".......XXXXXX.......",
+    ".......XXXXXX.......",
+    "......XXXXXXXX......",
+    "......XXXXXXXX......",
+    ".....XXXXXXXXXX.....",
+    ".....XXXXXXXXXX.....",
+    "....XXXXXXXXXXXX....",
+    "...XXXXXXXXXXXXXX...",
+    "..XXXXXXXXXXXXXXXX..",
+    ".XXXXXXXXXXXXXXXXXX.",
+    "XXXXXXXXXXXXXXXXXXXX",
+    "XXXXXXXXXXXXXXXXXXXX",
+    "XXXXXX.XXXXXX.XXXXXX",
+    "XXXXX..XXXXXX..XXXXX",
+    "XXXX...XXXXXX...XXXX",
+    ".XX....XXXXXX....XX.",
+    "........XXXX........"
+};
+
+static const char* const standard_art[] = {
+    "..XXXXXXXXXXX..",
+    ".XXXXXXXXXXXXX.",
+    "XXXXXXXXXXXXXXX",
+    "XXXXXXXXXXXXXXX",
+    "XXXXXXXXXXXXXXX",
+    "XXXXXXXXXXXXXXX",
+    "XXXXXXXXXXXXXXX",
+    "XXXXXXXXXXXXXXX",
+    ".XXXXXXXXXXXXX.",
+    "..XXXXXXXXXXX.."
+};
+
+static const char* const diamond_art[] = {
+    "....XX....",
+    "...XXXX...",
+    "..XXXXXX..",
+    ".XXXXXXXX.",
+    "XXXXXXXXXX",
+    "XXXXXXXXXX",
+    ".XXXXXXXX.",
+    "..XXXXXX..",
+    "...XXXX...",
+    "....XX...."
+};
+
+static const char* const girder_art[] = {
+    "XXXXXXXXXXXXXXXXXXXXXXXX",
+    "XXXXXXXXXXXXXXXXXXXXXXXX",
+    "XX..XXXX..XXXX..XXXX..XX",
+    "XX..XXXX..XXXX..XXXX..XX",
+    "XX..XXXX..XXXX..XXXX..XX",
+    "XX..XXXX..XXXX..XXXX..XX",
+    "XXXXXXXXXXXXXXXXXXXXXXXX",
+    "XXXXXXXXXXXXXXXXXXXXXXXX"
+};
+
+static const char* const capsule_art[] = {
+    "....XXXX....",
+    "..XXXXXXXX..",
+    ".XXXXXXXXXX.",
+    ".XXXXXXXXXX.",
+    "XXXXXXXXXXXX",
+    "XXXXXXXXXXXX",
+    "XXXXXXXXXXXX",
+    "XXXXXXXXXXXX",
+    "XXXXXXXXXXXX",
+    "XXXXXXXXXXXX",
+    "XXXXXXXXXXXX",
+    "XXXXXXXXXXXX",
+    ".XXXXXXXXXX.",
+    ".XXXXXXXXXX.",
+    "..XXXXXXXX..",
+    "....XXXX...."
+};
+
+static const char* const* const block_art[BLOCK_SIZE_COUNT] = {standard_art, diamond_art, girder_art, capsule_art};
+
+// The generated kernels; must come after the art they're generated from
+#include "sprite_kernels.h"
+
+static SpriteMask player_mask;
+static SpriteMask block_masks[BLOCK_SIZE_COUNT];
+
+/* Method definitions */
+
+void spriteInit() {
+    const int heights[BLOCK_SIZE_COUNT] = BLOCK_SIZE_HEIGHTS;
+
+    build_mask(&player_mask, player_art, PLAYER_HEIGHT);
+    player_mask.blit = player_blit;
+    player_mask.fill = player_fill;
+    for(int i = 0; i < BLOCK_SIZE_COUNT; i++) {
+        build_mask(&block_masks[i], block_art[i], heights[i]);
+        block_masks[i].blit = block_blits[i];
+        block_masks[i].fill = block_fills[i];
+    }
+}
+
+const SpriteMask* spritePlayer() {
+    return &player_mask;
+}
+
+const SpriteMask* spriteBlock(int size) {
+    return &block_masks[size];
+}
+
+int spriteCollide(const SpriteMask* a, int ax, int ay, const SpriteMask* b, int bx, int by) {
+    // Bounding boxes first; most pairs are nowhere near each other
+    if(ax >= bx + b->width || bx >= ax + a->width || ay >= by + b->height || by >= ay + a->height) return 0;
+
+    // The boxes overlap, so the sprites are less than 32 pixels apart and the shift is in range
+    int dx = bx - ax;
+    int top = ay > by ? ay : by;
+    int bottom = ay + a->height < by + b->height ? ay + a->height : by + b->height;
+
+    const uint32_t* a_row = a->rows + (top - ay);
+    const uint32_t* b_row = b->rows + (top - by);
+    uint32_t overlap = 0;
+    for(int i = 0; i < bottom - top; i++) {
+        overlap |= dx >= 0 ? a_row[i] & (b_row[i] >> dx) : (a_row[i] >> -dx) & b_row[i];
+    }
+
+    return overlap != 0;
+}
+
+void spriteDraw(const SpriteMask* sprite, int x, int y, uint16_t colour) {
+    spriteDrawRows(sprite, x, y, colour, 0, display_height);
+}
+
+void spriteDrawRows(const SpriteMask* sprite, int x, int y, uint16_t colour, int top, int bottom) {
+    if(top < 0) top = 0;
+    if(bottom > display_height) bottom = display_height;
+
+    // Wholly inside; the unrolled kernel
+    if(BLIT_KERNELS && x >= 0 && x + sprite->width <= display_width && y >= top && y + sprite->height <= bottom) {
+        sprite->blit(frame_buffer + y * display_width + x, display_width, colour);
+        return;
+    }
+
+    for(int row = 0; row < sprite->height; row++) {
+        int py = y + row;
+        if(py < top || py >= bottom) continue;
+
+        uint32_t bits = sprite->rows[row];
+        uint16_t* line = frame_buffer + py * display_width;
+        for(int col = 0; bits != 0; col++, bits <<= 1) {
+            int px = x + col;
+            if((bits & 0x80000000u) && px >= 0 && px < display_width) {
+                line[px] = colour;
+                pixelStatsPixel(px, py);
+            }
+        }
+    }
+}
+
+void spriteFillRows(const SpriteMask* sprite, int x, int y, uint16_t colour, int top, int bottom) {
+    if(top < 0) top = 0;
+    if(bottom > display_height) bottom = display_height;
+
+    int width = sprite->width;
+    int height = sprite->height;
+    if(x >= 0 && x + width <= display_width && y >= top && y + height <= bottom) {
+        pixelStatsRect(x, y, width, height);
+        sprite->fill(frame_buffer + y * display_width + x, display_width, colour);
+        return;
+    }
+
+    // Clip the parts of the box off the screen, and above/below the rows being drawn
+    if(x < 0) {
+        width += x;
+        x = 0;
+    }
+
+    if(x + width > display_width) width = display_width - x;
+
+    if(y < top) {
+        height -= top - y;
+        y = top;
+    }
+
+    if(y + height > bottom) height = bottom - y;
+    if(width <= 0 || height <= 0) return;
+
+    draw_rectangle(x, y, width, height, colour);
+}
+
+static void build_mask(SpriteMask* mask, const char* const* art, int height) {
+    mask->height = height;
+    mask->width = 0;
+    for(int row = 0; row < height; row++) {
+        uint32_t bits = 0;
+        int col = 0;
+        for(; art[row][col] != '\0' && col < 32; col++) {
+            if(art[row][col] == PIXEL) bits |= 0x80000000u >> col;
+        }
+
+        mask->rows[row] = bits;
+        if(col > mask->width) mask->width = col;
+    }
+}
@@ -0,0 +1,149 @@
+/*
+ * Determinism checks; prints a hash of the simulation state after every tick
+ * of a game, so two runs of the same seed and inputs can be compared tick by
+ * tick (see tools/statehash.py). Changes to how the simulation is computed
+ * (fixed point, data layout, compiler or platform) must not change how a game
+ * plays out, and this is how that's shown.
+ *
+ * Each part of the state is hashed separately, so the first tick two runs
+ * differ at also names what differs. Only what the game plays out with is
+ * hashed (whole pixel positions, not how they're stored), each folded to 16
+ * bits to keep the stream short. A tick is one line, about 30 bytes:
+ *
+ *     STATE BEGIN <seed> live|replay
+ *     STATE <tick> <player> <score> <velocity> <rng> <blocks>
+ *     STATE END <ticks> <score>
+ *
+ * The recorded game is hashed as it's played. A recording can then be re-run
+ * headlessly from flash (`replay verify` in the console), on a game of its own,
+ * to print the hashes of the re-run for comparison.
+ */
+#include <stdio.h>
+
+#include "statehash.h"
+#include "game.h"
+#include "replay.h"
+#include "gameclock.h"
+
+#define FNV_BASIS 0x811C9DC5
+#define FNV_PRIME 0x01000193
+
+/* Forward declaration of static methods */
+
+/*
+ * Returns 1 if the game's state is hashed; the recorded game, or one being re-run.
+ */
+static int hashed(const GameState* state);
+
+/*
+ * Folds a value in to a hash (FNV-1a, a word at a time), and a hash down to 16 bits.
+ */
+static uint32_t mix(uint32_t hash, int32_t value);
+static unsigned fold(uint32_t hash);
+
+/*
+ * Applies an event of the recording being re-run to its game.
+ */
+static void replay_event(ReplayEventType type, uint32_t value, void* arg);
+
+// The game recordings are re-run on
+static GameState replay_game;
+
+/* Method definitions */
+
+void stateHashBegin(const GameState* state, uint32_t seed) {
+    if(!STATE_HASH_ENABLED || !hashed(state)) return;
+
+    printf("STATE BEGIN %08x %s\n", (unsigned)seed, state->replaying ? "replay" : "live");
+}
+
+void stateHashTick(const GameState* state) {
+    if(!STATE_HASH_ENABLED || !hashed(state)) return;
+
+    uint32_t player = mix(mix(FNV_BASIS, state->player.x), state->player.y);
+    uint32_t score = mix(FNV_BASIS, state->player.score);
+    uint32_t velocity = mix(FNV_BASIS, state->velocity);
+    uint32_t rng = mix(FNV_BASIS, state->rng);
+
+    // Only the falling blocks; the rest are never seen and may hold anything
+    const GameBlocks* blocks = &state->blocks;
+    uint32_t falling = FNV_BASIS;
+    for(int i = 0; i < MAX_BLOCKS; i++) {
+        if(!blocks->enabled[i] || blocks->waiting_for_respawn[i]) continue;
+
+        falling = mix(falling, i);
+        falling = mix(falling, blocks->x[i]);
+        falling = mix(falling, BLOCK_Y(blocks, i));
+        falling = mix(falling, blocks->size[i]);
+        falling = mix(falling, blocks->speed[i]);
+        falling = mix(falling, blocks->velocity[i]);
+    }
+
+    printf("STATE %x %04x %04x %04x %04x %04x\n", (unsigned)state->ticks,
+        fold(player), fold(score), fold(velocity), fold(rng), fold(falling));
+}
+
+void stateHashEnd(const GameState* state) {
+    if(!STATE_HASH_ENABLED || !hashed(state)) return;
+
+    printf("STATE END %x %d\n", (unsigned)state->ticks, state->player.score);
+}
+
+int stateHashReplay(int position, const GameState* like) {
+    // Laid out like the original, and never recorded or entered in the high score table
+    replay_game = (GameState) {
+        .instance = 1,
+        .replaying = 1,
+        .field_x = like->field_x,
+        .field_width = like->field_width,
+        .phase = PHASE_MENU,
+        .highscore_rank = -1,
+        .last_spawned = -1
+    };
+    gameInit(&replay_game);
+
+    // The recorded ticks are already in game time, and nothing is drawn
+    gameClockSetScale(&replay_game.clock, 100);
+    replay_game.clock.headless = 1;
+
+    return replayRead(position, replay_event, &replay_game);
+}
+
+static int hashed(const GameState* state) {
+    return state->instance == 0 || state->replaying;
+}
+
+static uint32_t mix(uint32_t hash, int32_t value) {
+    for(int i = 0; i < 4; i++) {
+        hash = (hash ^ ((uint32_t)value & 0xFF)) * FNV_PRIME;
+        value >>= 8;
+    }
+
+    return hash;
+}
+
+static unsigned fold(uint32_t hash) {
+    return (hash >> 16) ^ (hash & 0xFFFF);
+}
+
+static void replay_event(ReplayEventType type, uint32_t value, void* arg) {
+    GameState* state = arg;
+    switch(type) {
+        case REPLAY_START:
+            gameStart(state, value);
+            break;
+        case REPLAY_BLOCK_LIMIT:
+            // The limit the game was recorded with, not the one set now
+            setBlockLimit(state, value);
+            break;
+        case REPLAY_TICK:
+            // A game may have been recorded past the point it ends here; that's a divergence too
+            if(state->phase == PHASE_GAME) handleTickPacket((GamePacket) {.type = PACKET_TICK, .data = value}, state);
+            break;
+        case REPLAY_INPUT:
+            if(state->phase == PHASE_GAME) handleInputPacket((GamePacket) {.type = PACKET_INPUT, .data = value}, state);
+            break;
+        case REPLAY_END:
+            break;
+    }
+}
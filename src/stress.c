@@ -0,0 +1,342 @@
+/*
+ * Bullet-hell stress mode; keeps raising the spawn rate until the screen holds
+ * thousands of small blocks, to find how far the simulation and rendering
+ * scale before the game drops below its frame rate.
+ *
+ * The normal blocks live in GameState and are few enough to be walked with
+ * per-block enabled flags. Here the blocks are kept densely packed at the front
+ * of a static pool instead (removing a block moves the last one in to its
+ * place), so every pass is a tight loop over exactly `count` entries:
+ *     - movement is the same branchless fixed point update as the game's,
+ *     - collisions first pick out, without branching, the few blocks level
+ *       with the player, and only test those properly,
+ *     - drawing fills each block straight in to the framebuffer rather than
+ *       going through draw_rectangle once per block.
+ *
+ * Each time the block count crosses a multiple of STRESS_REPORT_STEP, the
+ * average time per frame spent in each pass at the previous count is printed.
+ */
+#include <esp_timer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stress.h"
+#include "game.h"
+#include "replay.h"
+#include "profiler.h"
+#include "pixelstats.h"
+
+// Don't reserve the pool unless the mode is enabled
+#define POOL_SIZE (STRESS_MODE_ENABLED ? STRESS_MAX_BLOCKS : 1)
+
+// The range of block sizes (pixels) and fall speeds (pixels per second)
+#define MIN_SIZE 2
+#define MAX_SIZE 5
+#define MIN_VELOCITY 40
+#define MAX_VELOCITY_STRESS 120
+
+// Blocks are coloured by which third of the speed range they fall in
+#define COLOUR_COUNT 3
+
+// The time (ms) between ticks when the game is keeping up
+#define NOMINAL_DT (1000.0 / TARGET_FPS)
+
+// The run ends once the average tick length has been more than this share (percent) of
+// the nominal length for SLOW_WINDOWS consecutive seconds
+#define SLOW_LIMIT 120
+#define SLOW_WINDOWS 2
+
+typedef struct StressBlocks {
+    // The top edge of each block, in 16.16 fixed point
+    int32_t y[POOL_SIZE];
+    int16_t x[POOL_SIZE];
+    int16_t velocity[POOL_SIZE];
+    uint8_t width[POOL_SIZE];
+    uint8_t height[POOL_SIZE];
+    uint8_t colour[POOL_SIZE];
+} StressBlocks;
+
+// Time (us) spent in each pass while the block count was in the current report step
+typedef struct StressTimings {
+    int frames;
+    int64_t tick;
+    int64_t collisions;
+    int64_t render;
+} StressTimings;
+
+/* Forward declaration of static methods */
+
+/*
+ * Adds up to `amount` blocks to the pool. New blocks start just above the
+ * screen, or anywhere in the top half of it if `scatter` is set.
+ *
+ * Returns the amount of blocks actually added, which is less if the pool is full.
+ */
+static int spawn_blocks(GameState* state, int amount, int scatter);
+
+/*
+ * Moves every block down by its own velocity; `step` is the fraction of a
+ * second that has passed, in 16.16 fixed point.
+ */
+static void move_blocks(int32_t step);
+
+/*
+ * Removes the blocks that have left the bottom of the screen.
+ */
+static void despawn_blocks();
+
+/*
+ * Returns the amount of blocks touching the player.
+ */
+static int check_player(Player p);
+
+/*
+ * Tracks the tick lengths over each second, and ends the run once the
+ * game can't keep up (or the pool has been full for a whole second).
+ */
+static void track_frame_rate(double dt, int pool_full, GameState* state);
+
+/*
+ * Prints the average time per frame spent in each pass since the last
+ * report, if the block count has moved in to a new report step.
+ */
+static void report_timings();
+
+/*
+ * Moves to the death screen, with the most blocks held at full frame rate as the score.
+ */
+static void end_run(GameState* state, const char* reason);
+
+static StressBlocks pool;
+static int count = 0;
+
+// The indices of the blocks level with the player, found by the collision broad phase
+static uint16_t candidates[POOL_SIZE];
+
+static double elapsed = 0;
+static double spawn_credit = 0;
+static int hits = 0;
+
+// The most blocks held for a whole second at full frame rate
+static int peak = 0;
+
+// The second of ticks currently being measured
+static double window_dt = 0;
+static int window_ticks = 0;
+static int window_min_count = 0;
+static int window_pool_full = 0;
+static int slow_windows = 0;
+
+static int report_step = 0;
+static StressTimings timings;
+
+/* Method definitions */
+
+void stressBegin(GameState* state) {
+    count = 0;
+    elapsed = 0;
+    spawn_credit = 0;
+    hits = 0;
+    peak = 0;
+
+    window_dt = 0;
+    window_ticks = 0;
+    window_min_count = POOL_SIZE;
+    window_pool_full = 1;
+    slow_windows = 0;
+
+    report_step = 0;
+    timings = (StressTimings) {0};
+
+    // Start with as many blocks as the normal game can ever have
+    spawn_blocks(state, MAX_BLOCKS, 1);
+}
+
+void stressTick(double dt, GameState* state) {
+    int64_t start = esp_timer_get_time();
+
+    // The spawn rate rises steadily, so the block count keeps climbing until the pool is full
+    elapsed += dt;
+    int rate = STRESS_START_RATE + (int)(elapsed / 1000) * STRESS_RATE_GROWTH;
+    spawn_credit += rate * dt / 1000;
+
+    int wanted = spawn_credit;
+    spawn_credit -= wanted;
+    int pool_full = spawn_blocks(state, wanted, 0) < wanted;
+
+    move_blocks(dt * 65536 / 1000);
+    despawn_blocks();
+
+    int64_t moved = esp_timer_get_time();
+
+    // Hits are only counted; dying would end the run long before the interesting counts
+    profilerBegin(PROFILE_COLLISIONS);
+    hits += check_player(state->player);
+    profilerEnd(PROFILE_COLLISIONS);
+
+    int64_t end = esp_timer_get_time();
+    timings.tick += moved - start;
+    timings.collisions += end - moved;
+    timings.frames++;
+
+    report_timings();
+    track_frame_rate(dt, pool_full, state);
+}
+
+void stressRender(GameState* state) {
+    int64_t start = esp_timer_get_time();
+
+    const uint16_t palette[COLOUR_COUNT] = {
+        rgbToColour(255, 200, 0), rgbToColour(255, 100, 0), rgbToColour(255, 0, 60)
+    };
+
+    for(int i = 0; i < count; i++) {
+        int y = BLOCK_Y(&pool, i);
+        int height = pool.height[i];
+
+        // Blocks spawn above the screen and leave through the bottom; only x is always on screen
+        if(y < 0) {
+            height += y;
+            y = 0;
+        }
+
+        if(y + height > display_height) height = display_height - y;
+        if(height <= 0) continue;
+
+        uint16_t colour = palette[pool.colour[i]];
+        int width = pool.width[i];
+        pixelStatsRect(pool.x[i], y, width, height);
+        uint16_t* row = frame_buffer + y * display_width + pool.x[i];
+        for(int r = 0; r < height; r++) {
+            for(int c = 0; c < width; c++) row[c] = colour;
+            row += display_width;
+        }
+    }
+
+    timings.render += esp_timer_get_time() - start;
+}
+
+int stressBlockCount() {
+    return count;
+}
+
+static int spawn_blocks(GameState* state, int amount, int scatter) {
+    int spawned = 0;
+    for(; spawned < amount && count < POOL_SIZE; spawned++) {
+        int i = count++;
+
+        pool.width[i] = MIN_SIZE + gameRandom(state) % (MAX_SIZE - MIN_SIZE + 1);
+        pool.height[i] = MIN_SIZE + gameRandom(state) % (MAX_SIZE - MIN_SIZE + 1);
+        pool.x[i] = gameRandom(state) % (display_width - pool.width[i]);
+
+        int y = scatter ? gameRandom(state) % (display_height / 2) : -pool.height[i];
+        pool.y[i] = y * 65536;
+
+        int velocity = MIN_VELOCITY + gameRandom(state) % (MAX_VELOCITY_STRESS - MIN_VELOCITY + 1);
+        pool.velocity[i] = velocity;
+        pool.colour[i] = (velocity - MIN_VELOCITY) * COLOUR_COUNT / (MAX_VELOCITY_STRESS - MIN_VELOCITY + 1);
+    }
+
+    return spawned;
+}
+
+static void move_blocks(int32_t step) {
+    for(int i = 0; i < count; i++) {
+        pool.y[i] += pool.velocity[i] * step;
+    }
+}
+
+static void despawn_blocks() {
+    // Walk backwards so the block moved in to a freed slot has already been checked
+    for(int i = count - 1; i >= 0; i--) {
+        if(BLOCK_Y(&pool, i) < display_height) continue;
+
+        count--;
+        pool.y[i] = pool.y[count];
+        pool.x[i] = pool.x[count];
+        pool.velocity[i] = pool.velocity[count];
+        pool.width[i] = pool.width[count];
+        pool.height[i] = pool.height[count];
+        pool.colour[i] = pool.colour[count];
+    }
+}
+
+static int check_player(Player p) {
+    // Broad phase; only blocks whose top edge is within reach of the player's rows can
+    // touch it. The index is always written and only kept if the block is in range.
+    int32_t top = (p.y - MAX_SIZE) * 65536;
+    uint32_t range = (PLAYER_HEIGHT + MAX_SIZE + 1) * 65536;
+    int found = 0;
+    for(int i = 0; i < count; i++) {
+        candidates[found] = i;
+        found += (uint32_t)(pool.y[i] - top) < range;
+    }
+
+    // Narrow phase, the same test as the normal game's
+    int touching = 0;
+    for(int c = 0; c < found; c++) {
+        int i = candidates[c];
+        int x = pool.x[i];
+        int y = BLOCK_Y(&pool, i);
+        touching += !(p.x > x + pool.width[i] || p.x + PLAYER_WIDTH < x || p.y > y + pool.height[i] || p.y + PLAYER_HEIGHT < y);
+    }
+
+    return touching;
+}
+
+static void track_frame_rate(double dt, int pool_full, GameState* state) {
+    window_dt += dt;
+    window_ticks++;
+    if(count < window_min_count) window_min_count = count;
+    window_pool_full &= pool_full;
+
+    if(window_ticks < TARGET_FPS) return;
+
+    if(window_dt * 100 > window_ticks * NOMINAL_DT * SLOW_LIMIT) {
+        slow_windows++;
+    } else {
+        slow_windows = 0;
+        if(window_min_count > peak) peak = window_min_count;
+    }
+
+    int pool_was_full = window_pool_full;
+    window_dt = 0;
+    window_ticks = 0;
+    window_min_count = POOL_SIZE;
+    window_pool_full = 1;
+
+    if(slow_windows == SLOW_WINDOWS) {
+        end_run(state, "frame rate dropped");
+    } else if(pool_was_full && slow_windows == 0) {
+        end_run(state, "block pool full");
+    }
+}
+
+static void report_timings() {
+    int step = count / STRESS_REPORT_STEP;
+    if(step == report_step) return;
+
+    if(timings.frames > 0) {
+        int64_t frame_time = (timings.tick + timings.collisions + timings.render) / timings.frames;
+        printf("[STRESS] %4d-%4d blocks: tick %lldus, collisions %lldus, render %lldus per frame (%lld%% of frame budget)\n",
+            report_step * STRESS_REPORT_STEP, (report_step + 1) * STRESS_REPORT_STEP - 1,
+            timings.tick / timings.frames, timings.collisions / timings.frames, timings.render / timings.frames,
+            frame_time * TARGET_FPS / 10000);
+    }
+
+    report_step = step;
+    timings = (StressTimings) {0};
+}
+
+static void end_run(GameState* state, const char* reason) {
+    printf("[STRESS] Run over (%s) after %.1fs: held %d blocks at %d FPS, %d hits\n",
+        reason, elapsed / 1000, peak, TARGET_FPS, hits);
+
+    showDeathScreen(state);
+    state->player.score = peak;
+
+    // Stress runs aren't comparable with normal games, so stay out of the high score table
+    state->highscore_rank = -1;
+    replayEndGame(peak);
+}
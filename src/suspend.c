@@ -0,0 +1,178 @@
+/*
+ * Suspend to deep sleep; holding both buttons (or leaving the game alone for a
+ * while) puts the board in to deep sleep, and pressing the right button wakes
+ * it back in to exactly the game that was being played.
+ *
+ * Deep sleep powers down everything but the RTC, so the games are copied in to
+ * RTC slow memory (8KB, which fits a GameState per player) before sleeping and
+ * copied back over the freshly initialised games on wake. Nothing in a game
+ * depends on the wall clock (see gameclock.c), so a restored game carries on
+ * from the same tick.
+ *
+ * A GameState isn't wholly plain data; its pending timers (see timerwheel.c)
+ * hold callback addresses and the address of the game itself. These stay valid
+ * only when the same firmware restores the games in to the same (static)
+ * array, so the snapshot is stamped with the size of a GameState, the amount
+ * of games and part of the app's ELF hash, and ignored unless all three match.
+ *
+ * Resuming is a normal boot that skips the menu; the display has lost its
+ * state and is initialised as usual (graphics_init), with its backlight held
+ * off until then so the panel's power-on noise isn't shown. The time from the
+ * wake to the first frame of the restored game is printed. It doesn't include
+ * the bootloader, which checks the whole app image on every wake; IDF versions
+ * from 4.1 can skip that (CONFIG_BOOTLOADER_SKIP_VALIDATE_IN_DEEP_SLEEP).
+ */
+#include <driver/gpio.h>
+#include <driver/rtc_io.h>
+#include <esp_attr.h>
+#include <esp_ota_ops.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "suspend.h"
+#include "replay.h"
+
+#define SNAPSHOT_MAGIC 0x534C4550
+
+// The amount of bytes of the app's ELF hash stamped on a snapshot
+#define FIRMWARE_ID_LENGTH 8
+
+// The button that wakes the board (the right button); pressed is low
+#define WAKE_PIN GPIO_NUM_35
+
+// The most games kept; one per player in versus mode
+#define SNAPSHOT_GAMES 2
+
+// How long (ms) to wait for the replay writer to finish before sleeping anyway
+#define REPLAY_FLUSH_TIMEOUT 500
+
+// The games kept through deep sleep, and what they were kept by
+typedef struct SuspendSnapshot {
+    uint32_t magic;
+    uint32_t state_size;
+    uint32_t count;
+    uint8_t firmware[FIRMWARE_ID_LENGTH];
+    GameState games[SNAPSHOT_GAMES];
+} SuspendSnapshot;
+
+/* Forward declaration of static methods */
+
+/*
+ * Returns 1 if the snapshot holds `count` games kept by this firmware.
+ */
+static int snapshot_valid(int count);
+
+// Kept in RTC slow memory, which keeps its contents through deep sleep. Not
+// initialised at boot; the magic and stamps tell whether it holds games.
+static RTC_NOINIT_ATTR SuspendSnapshot snapshot;
+
+// Set when this boot is a wake by the wake button, until the first frame is shown
+static int waking;
+
+// When both buttons were first seen held together (0 while they aren't), and when a button or the console was last used
+static int64_t hold_start;
+static int64_t last_activity;
+
+/* Method definitions */
+
+void suspendInit() {
+    if(!SUSPEND_ENABLED) return;
+
+    // The backlight was held off through deep sleep; the display driver switches it on again
+    gpio_hold_dis(SUSPEND_BACKLIGHT_PIN);
+    gpio_deep_sleep_hold_dis();
+
+    waking = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0;
+    last_activity = esp_timer_get_time();
+
+    // The wake pin was handed to the RTC for deep sleep; give it back to the GPIO matrix
+    if(waking) rtc_gpio_deinit(WAKE_PIN);
+}
+
+int suspendRestore(GameState* games, int count) {
+    if(!SUSPEND_ENABLED || !waking) return 0;
+
+    if(!snapshot_valid(count)) {
+        printf("[SLEEP] Woken, but the kept games don't match this firmware; starting afresh\n");
+        waking = 0;
+        return 0;
+    }
+
+    memcpy(games, snapshot.games, count * sizeof(GameState));
+
+    // A snapshot is only ever restored once
+    snapshot.magic = 0;
+    return 1;
+}
+
+void suspendActivity() {
+    last_activity = esp_timer_get_time();
+}
+
+int suspendDue(int both_held) {
+    if(!SUSPEND_ENABLED || STRESS_MODE_ENABLED) return 0;
+
+    int64_t now = esp_timer_get_time();
+    if(!both_held) {
+        hold_start = 0;
+    } else if(hold_start == 0) {
+        hold_start = now;
+    }
+
+    if(hold_start != 0 && now - hold_start >= SUSPEND_HOLD_TIME * 1000LL) return 1;
+    return now - last_activity >= SUSPEND_IDLE_TIME * 1000000LL;
+}
+
+void suspendNow(const GameState* games, int count) {
+    printf("[SLEEP] Suspending %d game%s to deep sleep\n", count, count == 1 ? "" : "s");
+
+    cls(0);
+    setFont(FONT_UBUNTU16);
+    setFontColour(255, 255, 255);
+    print_xy("Sleeping", 10, 20);
+    setFont(FONT_SMALL);
+    setFontColour(150, 150, 150);
+    print_xy("Right button wakes", 10, 50);
+    flip_frame();
+
+    // A button still held would wake the board straight away (or be taken as a press on waking)
+    while(gpio_get_level(GPIO_NUM_0) == 0 || gpio_get_level(WAKE_PIN) == 0) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    if(!replayFlush(REPLAY_FLUSH_TIMEOUT)) printf("[WARNING] Replay writer didn't finish, the last recording may be lost\n");
+
+    if(count > SNAPSHOT_GAMES) count = SNAPSHOT_GAMES;
+    memcpy(snapshot.games, games, count * sizeof(GameState));
+    snapshot.state_size = sizeof(GameState);
+    snapshot.count = count;
+    memcpy(snapshot.firmware, esp_ota_get_app_description()->app_elf_sha256, FIRMWARE_ID_LENGTH);
+    snapshot.magic = SNAPSHOT_MAGIC;
+
+    // Keep the backlight off while asleep; it's most of what the board draws
+    gpio_set_level(SUSPEND_BACKLIGHT_PIN, 0);
+    gpio_hold_en(SUSPEND_BACKLIGHT_PIN);
+    gpio_deep_sleep_hold_en();
+
+    esp_sleep_enable_ext0_wakeup(WAKE_PIN, 0);
+    esp_deep_sleep_start();
+}
+
+void suspendFrameShown() {
+    if(!SUSPEND_ENABLED || !waking) return;
+
+    // esp_timer starts with the app, so this leaves out the ROM and bootloader
+    printf("[SLEEP] Resumed to the first frame in %.1fms since the app started\n", esp_timer_get_time() / 1.0e3);
+    waking = 0;
+}
+
+static int snapshot_valid(int count) {
+    if(snapshot.magic != SNAPSHOT_MAGIC || snapshot.state_size != sizeof(GameState)) return 0;
+    if(count > SNAPSHOT_GAMES || snapshot.count != (uint32_t)count) return 0;
+
+    return memcmp(snapshot.firmware, esp_ota_get_app_description()->app_elf_sha256, FIRMWARE_ID_LENGTH) == 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * Text formatting for the HUD and menus, in place of sprintf; drawing a frame
+ * shouldn't need to go through newlib's stdio (which takes a lock and may
+ * allocate) to put a number on screen.
+ */
+#include "textformat.h"
+
+/* Method definitions */
+
+char* formatText(char* out, const char* text) {
+    while(*text != '\0') *out++ = *text++;
+    *out = '\0';
+    return out;
+}
+
+char* formatInt(char* out, int value, int min_digits) {
+    // Work with the magnitude as unsigned, so INT_MIN doesn't overflow
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    if(value < 0) {
+        // As with printf, the sign counts towards the width
+        *out++ = '-';
+        min_digits--;
+    }
+
+    // Digits come out least significant first, so build them backwards
+    char digits[10];
+    int count = 0;
+    do {
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while(magnitude != 0);
+
+    for(int i = count; i < min_digits; i++) *out++ = '0';
+    while(count > 0) *out++ = digits[--count];
+
+    *out = '\0';
+    return out;
+}
@@ -0,0 +1,235 @@
+/*
+ * The game tick timer; signals the game task every 1/TARGET_FPS seconds, and
+ * measures how evenly it manages to do so.
+ *
+ * Uneven ticks show up directly as uneven motion in the game, so the timer can
+ * either be the ESP high resolution timer (whose callback runs in the esp_timer
+ * task, behind any other timers that are due) or a hardware timer group, whose
+ * interrupt notifies the game task directly. Either way the clock is read once
+ * per tick, so the dt handed to the game covers exactly the time between ticks.
+ *
+ * Two things are measured: how far each tick's interval strays from the
+ * nominal period (the timer's jitter), and how long the game task takes to
+ * pick the tick up after it fires (scheduling latency).
+ */
+#include <driver/timer.h>
+#include <esp_timer.h>
+#include <stdio.h>
+
+#include "ticktimer.h"
+
+// The nominal time between ticks (us) at boot; see tickTimerSetFps
+#define TICK_PERIOD (1000000 / TARGET_FPS)
+
+// The timer group counts in microseconds; the APB clock stays at 80MHz under DFS as the
+// CPU never drops below 80MHz (see power.c)
+#define TIMER_GROUP_DIVIDER 80
+
+#define HISTOGRAM_BUCKETS 6
+
+typedef struct TickJitterStats {
+    // Recorded by the tick source, per tick
+    int ticks;
+    int64_t total_deviation;
+    int max_deviation;
+    int histogram[HISTOGRAM_BUCKETS];
+
+    // Recorded by the game task, each time it takes the pending time
+    int takes;
+    int64_t total_latency;
+    int max_latency;
+} TickJitterStats;
+
+/* Forward declaration of static methods */
+
+/*
+ * Stores the time of a tick; adds the time since the last tick to the pending
+ * dt, and records how far the interval strayed from the tick period.
+ *
+ * Must be called with `tick_lock` held.
+ */
+static void record_tick(int64_t now);
+
+/*
+ * The tick callbacks for each of the timer sources.
+ */
+static void esp_timer_tick_callback(void* arg);
+static void timer_group_tick_isr(void* arg);
+
+/*
+ * Configure and start each of the timer sources.
+ */
+static void start_esp_timer();
+static void start_timer_group();
+
+static TaskHandle_t notify_task;
+static esp_timer_handle_t game_timer;
+
+// The upper bound (us) of each histogram bucket of tick interval deviation; the last bucket
+// holds everything beyond. Kept in DRAM as the timer group ISR may run while the flash
+// cache is disabled.
+static DRAM_ATTR const int histogram_limits[HISTOGRAM_BUCKETS - 1] = {50, 100, 250, 500, 1000};
+
+// Guards everything below, which is shared between the tick source and the game task
+static portMUX_TYPE tick_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t last_tick_time = 0;
+static int64_t pending_dt = 0;
+static int64_t pending_since = 0;
+static TickJitterStats stats;
+
+// The time between ticks (us); only changed by tickTimerSetFps
+static int tick_period = TICK_PERIOD;
+
+/* Method definitions */
+
+void tickTimerStart(TaskHandle_t game_task) {
+    notify_task = game_task;
+
+    if(GAME_TIMER_SOURCE == GAME_TIMER_HW_GROUP) {
+        start_timer_group();
+    } else {
+        start_esp_timer();
+    }
+}
+
+int tickTimerTakeDt() {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&tick_lock);
+    int64_t dt = pending_dt;
+    int64_t since = pending_since;
+    pending_dt = 0;
+    pending_since = 0;
+    portEXIT_CRITICAL(&tick_lock);
+
+    if(since > 0) {
+        int latency = now - since;
+        stats.takes++;
+        stats.total_latency += latency;
+        if(latency > stats.max_latency) stats.max_latency = latency;
+
+        if(stats.takes == TIMER_STATS_INTERVAL) tickTimerReport();
+    }
+
+    return dt;
+}
+
+void tickTimerSkip() {
+    portENTER_CRITICAL(&tick_lock);
+    pending_dt = 0;
+    pending_since = 0;
+    portEXIT_CRITICAL(&tick_lock);
+}
+
+void tickTimerSetFps(int fps) {
+    if(fps < 1) fps = 1;
+
+    portENTER_CRITICAL(&tick_lock);
+    tick_period = 1000000 / fps;
+    portEXIT_CRITICAL(&tick_lock);
+
+    // The new period takes effect from the next tick
+    if(GAME_TIMER_SOURCE == GAME_TIMER_HW_GROUP) {
+        timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, tick_period);
+    } else {
+        esp_timer_stop(game_timer);
+        esp_timer_start_periodic(game_timer, tick_period);
+    }
+}
+
+void tickTimerReport() {
+    portENTER_CRITICAL(&tick_lock);
+    TickJitterStats snapshot = stats;
+    stats = (TickJitterStats) {0};
+    portEXIT_CRITICAL(&tick_lock);
+
+    if(snapshot.ticks == 0) return;
+
+    printf("[TIMER] %s: interval jitter avg %lldus max %dus, ",
+        GAME_TIMER_SOURCE == GAME_TIMER_HW_GROUP ? "timer group" : "esp_timer",
+        snapshot.total_deviation / snapshot.ticks, snapshot.max_deviation);
+
+    // The game task may not have taken a tick since the stats were last reset (the report on
+    // every TIMER_STATS_INTERVAL-th take resets them too)
+    if(snapshot.takes > 0) {
+        printf("latency avg %lldus max %dus\n", snapshot.total_latency / snapshot.takes, snapshot.max_latency);
+    } else {
+        printf("no ticks taken yet\n");
+    }
+
+    printf("[TIMER] jitter histogram: <=50us %d, <=100us %d, <=250us %d, <=500us %d, <=1ms %d, >1ms %d\n",
+        snapshot.histogram[0], snapshot.histogram[1], snapshot.histogram[2],
+        snapshot.histogram[3], snapshot.histogram[4], snapshot.histogram[5]);
+}
+
+static void IRAM_ATTR record_tick(int64_t now) {
+    int64_t dt = last_tick_time > 0 ? now - last_tick_time : tick_period;
+    last_tick_time = now;
+
+    pending_dt += dt;
+    if(pending_since == 0) pending_since = now;
+
+    int deviation = dt > tick_period ? dt - tick_period : tick_period - dt;
+    stats.ticks++;
+    stats.total_deviation += deviation;
+    if(deviation > stats.max_deviation) stats.max_deviation = deviation;
+
+    int bucket = 0;
+    while(bucket < HISTOGRAM_BUCKETS - 1 && deviation > histogram_limits[bucket]) bucket++;
+    stats.histogram[bucket]++;
+}
+
+static void esp_timer_tick_callback(void* arg) {
+    portENTER_CRITICAL(&tick_lock);
+    record_tick(esp_timer_get_time());
+    portEXIT_CRITICAL(&tick_lock);
+
+    xTaskNotify(notify_task, GAME_NOTIFY_TICK, eSetBits);
+}
+
+static void IRAM_ATTR timer_group_tick_isr(void* arg) {
+    timer_group_clr_intr_status_in_isr(TIMER_GROUP_0, TIMER_0);
+    timer_group_enable_alarm_in_isr(TIMER_GROUP_0, TIMER_0);
+
+    portENTER_CRITICAL_ISR(&tick_lock);
+    record_tick(esp_timer_get_time());
+    portEXIT_CRITICAL_ISR(&tick_lock);
+
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(notify_task, GAME_NOTIFY_TICK, eSetBits, &woken);
+    if(woken == pdTRUE) portYIELD_FROM_ISR();
+}
+
+static void start_esp_timer() {
+    // To reduce complexity when handling light-sleep, dynamic frequency, etc.. we're using the high-resoultion
+    // timers provided by ESP-IDF, rather than the low-priority timers provided by FreeRTOS.
+    const esp_timer_create_args_t game_tick_args = {
+        .callback = &esp_timer_tick_callback,
+        .name = "Gametimer"
+    };
+    esp_timer_create(&game_tick_args, &game_timer);
+
+    // Start the timer to run at 30 ticks per second (second / target runs per second) converted to microseconds
+    esp_timer_start_periodic(game_timer, tick_period);
+}
+
+static void start_timer_group() {
+    timer_config_t config = {
+        .divider = TIMER_GROUP_DIVIDER,
+        .counter_dir = TIMER_COUNT_UP,
+        .counter_en = TIMER_PAUSE,
+        .alarm_en = TIMER_ALARM_EN,
+        .intr_type = TIMER_INTR_LEVEL,
+        .auto_reload = TIMER_AUTORELOAD_EN
+    };
+    timer_init(TIMER_GROUP_0, TIMER_0, &config);
+
+    // Count up from zero to the tick period, then reload and fire
+    timer_set_counter_value(TIMER_GROUP_0, TIMER_0, 0);
+    timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, tick_period);
+    timer_enable_intr(TIMER_GROUP_0, TIMER_0);
+
+    // IRAM so ticks keep coming while the flash cache is disabled (e.g. replay writes)
+    timer_isr_register(TIMER_GROUP_0, TIMER_0, timer_group_tick_isr, NULL, ESP_INTR_FLAG_IRAM, NULL);
+    timer_start(TIMER_GROUP_0, TIMER_0);
+}
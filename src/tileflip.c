@@ -0,0 +1,126 @@
+/*
+ * Change detection before the frame is flipped, so no render function has to
+ * report what it drew (the menu and game over text included).
+ *
+ * Each 16x16 tile of the framebuffer is hashed (see tilehash.c) and compared
+ * to its hash in the last frame flipped. The changed tiles of each tile row are
+ * merged in to runs; a run is a single rectangle, which is what a partial update
+ * of the display would send.
+ *
+ * A renderer can hand on each band of the frame as it's finished (tileFlipBand),
+ * so its tiles are hashed then and only the rest are left for the flip; the
+ * game hands on its whole frame in one band (see render_game).
+ *
+ * The graphics library only sends whole frames, so for now a frame is either
+ * flipped whole or, when no tile changed, not at all. Skipping those flips saves
+ * the whole SPI transfer on every still frame; the run counts report how much a
+ * partial update would save on the rest.
+ */
+#include <stdio.h>
+
+#include "tileflip.h"
+#include "tilehash.h"
+#include "pixelstats.h"
+
+/* Forward declaration of static methods */
+
+/*
+ * Counts the changed tiles, and the runs they form along each tile row.
+ */
+static void count_changes(int* changed, int* runs);
+
+/*
+ * Prints the change statistics of the last TILE_FLIP_REPORT_INTERVAL frames, and resets them.
+ */
+static void report();
+
+// The tile hashes of the frame being flipped, and of the last frame flipped
+static uint32_t hash_buffers[2][MAX_TILES];
+static uint32_t* current_hashes = hash_buffers[0];
+static uint32_t* flipped_hashes = hash_buffers[1];
+
+// The tile count the flipped hashes were taken at; the first frame, or one
+// after the orientation changes, is always flipped
+static int flipped_tiles = 0;
+
+// The tile rows of the frame being drawn that were hashed as bands were finished
+static int hashed_rows = 0;
+
+// Statistics since the last report
+static int frames = 0;
+static int skipped = 0;
+static int changed_total = 0;
+static int runs_total = 0;
+
+/* Method definitions */
+
+void tileFlipFrame() {
+    if(!TILE_FLIP_ENABLED) {
+        flip_frame();
+        return;
+    }
+
+    int tiles = tileColumns() * tileRows();
+    tileHashRows(current_hashes, hashed_rows, tileRows());
+    hashed_rows = 0;
+
+    int changed = tiles;
+    int runs = tileRows();
+    if(tiles == flipped_tiles) count_changes(&changed, &runs);
+
+    if(changed > 0) {
+        flip_frame();
+
+        uint32_t* swap = flipped_hashes;
+        flipped_hashes = current_hashes;
+        current_hashes = swap;
+        flipped_tiles = tiles;
+    } else {
+        // The frame was still drawn; its writes mustn't be counted in the next flipped frame's
+        pixelStatsFrameEnd();
+        skipped++;
+    }
+
+    frames++;
+    changed_total += changed;
+    runs_total += runs;
+    if(frames == TILE_FLIP_REPORT_INTERVAL) report();
+}
+
+void tileFlipBand(int top, int bottom) {
+    if(!TILE_FLIP_ENABLED || top != hashed_rows * TILE_SIZE) return;
+
+    // A band ending part way through a tile row leaves that row for the next band
+    int end_row = bottom >= display_height ? tileRows() : bottom / TILE_SIZE;
+    tileHashRows(current_hashes, hashed_rows, end_row);
+    hashed_rows = end_row;
+}
+
+static void count_changes(int* changed, int* runs) {
+    int columns = tileColumns();
+    int rows = tileRows();
+
+    *changed = 0;
+    *runs = 0;
+    for(int row = 0; row < rows; row++) {
+        int in_run = 0;
+        for(int i = row * columns; i < (row + 1) * columns; i++) {
+            int differs = current_hashes[i] != flipped_hashes[i];
+            *changed += differs;
+            *runs += differs & !in_run;
+            in_run = differs;
+        }
+    }
+}
+
+static void report() {
+    int tiles = tileColumns() * tileRows();
+    printf("[TILES] %d of %d frames unchanged (flip skipped); %d.%d of %d tiles changed in %d.%d runs per frame\n",
+        skipped, frames, changed_total / frames, changed_total * 10 / frames % 10, tiles,
+        runs_total / frames, runs_total * 10 / frames % 10);
+
+    frames = 0;
+    skipped = 0;
+    changed_total = 0;
+    runs_total = 0;
+}
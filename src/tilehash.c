@@ -0,0 +1,62 @@
+#include <stdint.h>
+
+#include "tilehash.h"
+
+/* Forward declaration of static methods */
+
+/*
+ * Hashes the pixels in the rectangle provided. Pixels are folded in two at a time
+ * as the framebuffer rows aren't 32-bit aligned (display_width is odd) and the
+ * Xtensa core can't do unaligned word loads.
+ */
+static uint32_t hash_rect(const uint16_t* pixels, int x, int y, int width, int height);
+
+/* Method definitions */
+
+int tileColumns() {
+    return (display_width + TILE_SIZE - 1) / TILE_SIZE;
+}
+
+int tileRows() {
+    return (display_height + TILE_SIZE - 1) / TILE_SIZE;
+}
+
+void tileBounds(int index, int* x, int* y, int* width, int* height) {
+    int columns = tileColumns();
+    *x = (index % columns) * TILE_SIZE;
+    *y = (index / columns) * TILE_SIZE;
+    *width = display_width - *x < TILE_SIZE ? display_width - *x : TILE_SIZE;
+    *height = display_height - *y < TILE_SIZE ? display_height - *y : TILE_SIZE;
+}
+
+void tileHashFrame(uint32_t* hashes) {
+    tileHashRows(hashes, 0, tileRows());
+}
+
+void tileHashRows(uint32_t* hashes, int first_row, int end_row) {
+    int columns = tileColumns();
+    for(int i = first_row * columns; i < end_row * columns; i++) {
+        int x, y, width, height;
+        tileBounds(i, &x, &y, &width, &height);
+        hashes[i] = hash_rect(frame_buffer, x, y, width, height);
+    }
+}
+
+static uint32_t hash_rect(const uint16_t* pixels, int x, int y, int width, int height) {
+    uint32_t hash = 0x811C9DC5;
+    for(int row = y; row < y + height; row++) {
+        const uint16_t* p = pixels + row * display_width + x;
+        int col = 0;
+        for(; col + 1 < width; col += 2) {
+            hash = (hash ^ (p[col] | ((uint32_t)p[col + 1] << 16))) * 0x9E3779B1;
+            hash ^= hash >> 15;
+        }
+
+        if(col < width) {
+            hash = (hash ^ p[col]) * 0x9E3779B1;
+            hash ^= hash >> 15;
+        }
+    }
+
+    return hash;
+}
@@ -0,0 +1,218 @@
+/*
+ * Hierarchical timer wheel, for everything that should happen after a while
+ * of game time (returning to the menu, ignoring early button presses, etc).
+ *
+ * Rather than each feature comparing the time every tick, it schedules a
+ * callback. Time is counted in steps of TIMER_WHEEL_RESOLUTION ms, and each
+ * level of the wheel is a ring of slots holding a linked list of timers:
+ *     level 0 holds timers due within TIMER_WHEEL_SLOTS steps, one slot per step,
+ *     level 1 those due within TIMER_WHEEL_SLOTS ^ 2 steps, a slot per
+ *     TIMER_WHEEL_SLOTS steps, and so on.
+ * Scheduling and cancelling only link or unlink a node. Each step fires the
+ * due level 0 slot; whenever level 0 wraps around, the next slot of level 1 is
+ * re-inserted in to level 0 (and likewise further up).
+ *
+ * Timers come from a fixed pool, and are referred to by handles that include
+ * a generation count, so a stale handle can never cancel someone else's timer.
+ * Each game has a wheel of its own in its GameState, so games can run side by side.
+ */
+#include <stdio.h>
+
+#include "timerwheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define NONE -1
+
+// The bits of a step count covered by each level
+#define SLOT_BITS (__builtin_ctz(TIMER_WHEEL_SLOTS))
+
+#if (TIMER_WHEEL_SLOTS & SLOT_MASK) != 0
+#error "TIMER_WHEEL_SLOTS must be a power of two"
+#endif
+
+/* Forward declaration of static methods */
+
+/*
+ * Links a node in to the slot its expiry belongs in.
+ */
+static void insert(TimerWheel* wheel, int node);
+
+/*
+ * Unlinks a node from whichever slot it's in.
+ */
+static void unlink_node(TimerWheel* wheel, int node);
+
+/*
+ * Returns a node to the free list, invalidating any handles to it.
+ */
+static void free_node(TimerWheel* wheel, int node);
+
+/*
+ * Re-inserts every timer in a slot of a higher level, moving each closer to level 0.
+ */
+static void cascade(TimerWheel* wheel, int level, int slot);
+
+/*
+ * Advances the wheel a single step, firing the timers that are due.
+ */
+static void step(TimerWheel* wheel);
+
+/*
+ * Returns the node a handle refers to, or NONE if the timer isn't pending.
+ */
+static int resolve(const TimerWheel* wheel, GameTimer timer);
+
+/* Method definitions */
+
+void timerWheelReset(TimerWheel* wheel) {
+    for(int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for(int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) wheel->slots[level][slot] = NONE;
+    }
+
+    // Generations carry on from before, so handles from before the reset stay stale
+    for(int i = 0; i < GAME_TIMER_COUNT; i++) {
+        wheel->nodes[i].pending = 0;
+        wheel->nodes[i].next = i + 1 < GAME_TIMER_COUNT ? i + 1 : NONE;
+    }
+
+    wheel->free_nodes = 0;
+    wheel->now = 0;
+    wheel->carry = 0;
+}
+
+void timerWheelAdvance(TimerWheel* wheel, int dt) {
+    wheel->carry += dt;
+    while(wheel->carry >= TIMER_WHEEL_RESOLUTION * 1000) {
+        wheel->carry -= TIMER_WHEEL_RESOLUTION * 1000;
+        step(wheel);
+    }
+}
+
+uint32_t timerWheelNow(const TimerWheel* wheel) {
+    return wheel->now * TIMER_WHEEL_RESOLUTION + wheel->carry / 1000;
+}
+
+GameTimer timerSchedule(TimerWheel* wheel, int delay, GameTimerCallback callback, void* arg) {
+    if(wheel->free_nodes == NONE) {
+        printf("[WARNING] All %d game timers are in use, timer not scheduled\n", GAME_TIMER_COUNT);
+        return 0;
+    }
+
+    int node = wheel->free_nodes;
+    wheel->free_nodes = wheel->nodes[node].next;
+
+    // Always at least a step away, so a timer scheduled by a callback never fires in the same step
+    int steps = (delay + TIMER_WHEEL_RESOLUTION - 1) / TIMER_WHEEL_RESOLUTION;
+    if(steps < 1) steps = 1;
+
+    TimerNode* n = &wheel->nodes[node];
+    n->expires = wheel->now + steps;
+    n->callback = callback;
+    n->arg = arg;
+    n->pending = 1;
+    insert(wheel, node);
+
+    return (uint32_t)n->generation << 16 | (node + 1);
+}
+
+void timerCancel(TimerWheel* wheel, GameTimer timer) {
+    int node = resolve(wheel, timer);
+    if(node == NONE) return;
+
+    unlink_node(wheel, node);
+    free_node(wheel, node);
+}
+
+int timerRemaining(const TimerWheel* wheel, GameTimer timer) {
+    int node = resolve(wheel, timer);
+    if(node == NONE) return -1;
+
+    int remaining = (wheel->nodes[node].expires - wheel->now) * TIMER_WHEEL_RESOLUTION - wheel->carry / 1000;
+    return remaining > 0 ? remaining : 0;
+}
+
+static void insert(TimerWheel* wheel, int node) {
+    TimerNode* n = &wheel->nodes[node];
+    uint32_t delta = n->expires - wheel->now;
+
+    // Timers beyond the top level wait in its furthest slot, and are re-inserted when it comes
+    // round; only the slot is chosen as if it were due then, the timer keeps its expiry
+    uint32_t limit = 1u << (SLOT_BITS * TIMER_WHEEL_LEVELS);
+    if(delta >= limit) delta = limit - 1;
+
+    int level = 0;
+    while(level < TIMER_WHEEL_LEVELS - 1 && delta >= 1u << (SLOT_BITS * (level + 1))) level++;
+
+    int slot = ((wheel->now + delta) >> (SLOT_BITS * level)) & SLOT_MASK;
+    n->next = wheel->slots[level][slot];
+    if(n->next != NONE) wheel->nodes[n->next].prev = node;
+
+    // The slot is recorded in `prev` of the head as -(index + 2), so unlinking needs no search
+    n->prev = -(level * TIMER_WHEEL_SLOTS + slot) - 2;
+    wheel->slots[level][slot] = node;
+}
+
+static void unlink_node(TimerWheel* wheel, int node) {
+    TimerNode* n = &wheel->nodes[node];
+    if(n->prev >= 0) {
+        wheel->nodes[n->prev].next = n->next;
+    } else {
+        int index = -n->prev - 2;
+        wheel->slots[index / TIMER_WHEEL_SLOTS][index % TIMER_WHEEL_SLOTS] = n->next;
+    }
+
+    if(n->next != NONE) wheel->nodes[n->next].prev = n->prev;
+}
+
+static void cascade(TimerWheel* wheel, int level, int slot) {
+    int node = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NONE;
+
+    while(node != NONE) {
+        int next = wheel->nodes[node].next;
+        insert(wheel, node);
+        node = next;
+    }
+}
+
+static void step(TimerWheel* wheel) {
+    uint32_t now = ++wheel->now;
+
+    // When a level wraps around, bring the next slot of the level above down, highest level first
+    for(int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+        if((now & ((1u << (SLOT_BITS * level)) - 1)) == 0) {
+            cascade(wheel, level, (now >> (SLOT_BITS * level)) & SLOT_MASK);
+        }
+    }
+
+    // Take the due timers one at a time, as a callback may cancel the others. New timers are
+    // always at least a step away, so they never land in this slot.
+    int slot = now & SLOT_MASK;
+    while(wheel->slots[0][slot] != NONE) {
+        int node = wheel->slots[0][slot];
+        GameTimerCallback callback = wheel->nodes[node].callback;
+        void* arg = wheel->nodes[node].arg;
+
+        // Free the node before calling back, so the callback can schedule timers of its own
+        unlink_node(wheel, node);
+        free_node(wheel, node);
+        callback(arg);
+    }
+}
+
+static void free_node(TimerWheel* wheel, int node) {
+    wheel->nodes[node].pending = 0;
+    wheel->nodes[node].generation++;
+    wheel->nodes[node].next = wheel->free_nodes;
+    wheel->free_nodes = node;
+}
+
+static int resolve(const TimerWheel* wheel, GameTimer timer) {
+    int node = (int)(timer & 0xFFFF) - 1;
+    if(node < 0 || node >= GAME_TIMER_COUNT) return NONE;
+
+    const TimerNode* n = &wheel->nodes[node];
+    if(!n->pending || n->generation != timer >> 16) return NONE;
+
+    return node;
+}
@@ -0,0 +1,102 @@
+/*
+ * Unit tests for the game timer wheel (src/timerwheel.c); run on the board with
+ * `pio test -e tdisplay -f test_timerwheel`.
+ *
+ * The wheel is pure game-time bookkeeping, so the tests drive it by hand one
+ * step at a time and check the game time each timer fires at.
+ */
+#include <unity.h>
+
+// The project sources aren't built in to tests; this one has no dependencies of its own
+#include "../../src/timerwheel.c"
+
+// The game time (ms) each test timer fired at, -1 until it has
+static int64_t fired_at[GAME_TIMER_COUNT];
+
+static TimerWheel wheel;
+
+static void record_fire(void* arg) {
+    fired_at[(intptr_t)arg] = timerWheelNow(&wheel);
+}
+
+// Advances the wheel a step at a time until `time` ms of game time have passed
+static void advance_to(int64_t time) {
+    while((int64_t)timerWheelNow(&wheel) < time) timerWheelAdvance(&wheel, TIMER_WHEEL_RESOLUTION * 1000);
+}
+
+void setUp() {
+    timerWheelReset(&wheel);
+    for(int i = 0; i < GAME_TIMER_COUNT; i++) fired_at[i] = -1;
+}
+
+void tearDown() {
+}
+
+static void test_fires_after_delay() {
+    timerSchedule(&wheel, 100, record_fire, (void*)0);
+    timerSchedule(&wheel, 5, record_fire, (void*)1);
+
+    advance_to(90);
+    TEST_ASSERT_EQUAL_INT(-1, fired_at[0]);
+    TEST_ASSERT_EQUAL_INT(TIMER_WHEEL_RESOLUTION, fired_at[1]);
+
+    advance_to(100);
+    TEST_ASSERT_EQUAL_INT(100, fired_at[0]);
+}
+
+static void test_cancel() {
+    GameTimer cancelled = timerSchedule(&wheel, 200, record_fire, (void*)0);
+    timerSchedule(&wheel, 300, record_fire, (void*)1);
+
+    timerCancel(&wheel, cancelled);
+    TEST_ASSERT_EQUAL_INT(-1, timerRemaining(&wheel, cancelled));
+
+    // The node is reused by the next timer; the stale handle mustn't cancel it
+    GameTimer reused = timerSchedule(&wheel, 250, record_fire, (void*)2);
+    timerCancel(&wheel, cancelled);
+    TEST_ASSERT_EQUAL_INT(250, timerRemaining(&wheel, reused));
+
+    advance_to(1000);
+    TEST_ASSERT_EQUAL_INT(-1, fired_at[0]);
+    TEST_ASSERT_EQUAL_INT(300, fired_at[1]);
+    TEST_ASSERT_EQUAL_INT(250, fired_at[2]);
+}
+
+static void test_cascade() {
+    // Past level 0, past level 1, and on the boundaries between them
+    int level_0 = TIMER_WHEEL_RESOLUTION * TIMER_WHEEL_SLOTS;
+    int level_1 = level_0 * TIMER_WHEEL_SLOTS;
+    int delays[4] = {level_0 - TIMER_WHEEL_RESOLUTION, level_0 + 30, level_1, level_1 * 3 + 70};
+
+    // Start part way through a level 0 rotation, so the slots don't line up with the delays
+    advance_to(130);
+    for(int i = 0; i < 4; i++) timerSchedule(&wheel, delays[i], record_fire, (void*)(intptr_t)i);
+
+    advance_to(130 + delays[3]);
+    for(int i = 0; i < 4; i++) TEST_ASSERT_EQUAL_INT(130 + delays[i], fired_at[i]);
+}
+
+static void test_beyond_range() {
+    int64_t range = (int64_t)TIMER_WHEEL_RESOLUTION * TIMER_WHEEL_SLOTS * TIMER_WHEEL_SLOTS * TIMER_WHEEL_SLOTS;
+    int delay = 3000000;
+    TEST_ASSERT_TRUE(delay > range);
+
+    GameTimer timer = timerSchedule(&wheel, delay, record_fire, (void*)0);
+    TEST_ASSERT_EQUAL_INT(delay, timerRemaining(&wheel, timer));
+
+    advance_to(range);
+    TEST_ASSERT_EQUAL_INT(-1, fired_at[0]);
+    TEST_ASSERT_EQUAL_INT(delay - range, timerRemaining(&wheel, timer));
+
+    advance_to(delay);
+    TEST_ASSERT_EQUAL_INT(delay, fired_at[0]);
+}
+
+void app_main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fires_after_delay);
+    RUN_TEST(test_cancel);
+    RUN_TEST(test_cascade);
+    RUN_TEST(test_beyond_range);
+    UNITY_END();
+}
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""
+Host side decoder for the frame stream written by src/framestream.c.
+
+Reads the raw serial stream (from a serial device, a capture file or stdin),
+applies each frame's changed tiles to a local copy of the framebuffer, and
+writes every rebuilt frame out as a PPM image, or as raw RGB24 video that can
+be piped straight in to ffmpeg:
+
+    stty -F /dev/ttyUSB0 115200 raw
+    python3 tools/framestream.py /dev/ttyUSB0 --out-dir frames/
+    python3 tools/framestream.py capture.bin --raw | \\
+        ffmpeg -f rawvideo -pix_fmt rgb24 -s 135x240 -r 30 -i - game.mp4
+
+Frames with a bad checksum (including console output mixed in to the stream)
+are skipped.
+"""
+import argparse
+import os
+import struct
+import sys
+
+SYNC = b"\xa5\xc3"
+
+
+def fletcher16(data):
+    sum1 = sum2 = 0
+    for byte in data:
+        sum1 = (sum1 + byte) % 255
+        sum2 = (sum2 + sum1) % 255
+    return (sum2 << 8) | sum1
+
+
+def frames(stream):
+    """Yields the body of every valid frame in the byte stream."""
+    buffer = bytearray()
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            return
+        buffer += chunk
+        while True:
+            start = buffer.find(SYNC)
+            if start < 0:
+                del buffer[:-1]
+                break
+            if len(buffer) < start + 6:
+                del buffer[:start]
+                break
+            (length,) = struct.unpack_from("<I", buffer, start + 2)
+            end = start + 6 + length + 2
+            if length > 1 << 20:
+                del buffer[:start + 1]
+                continue
+            if len(buffer) < end:
+                del buffer[:start]
+                break
+            body = bytes(buffer[start + 6:end - 2])
+            (checksum,) = struct.unpack_from("<H", buffer, end - 2)
+            if fletcher16(body) == checksum:
+                yield body
+                del buffer[:end]
+            else:
+                del buffer[:start + 1]
+
+
+class Framebuffer:
+    def __init__(self, swap):
+        self.swap = swap
+        self.width = 0
+        self.height = 0
+        self.pixels = []
+
+    def apply(self, body):
+        frame_number, width, height, tile_size = struct.unpack_from("<IHHB", body, 0)
+        if (width, height) != (self.width, self.height):
+            self.width, self.height = width, height
+            self.pixels = [0] * (width * height)
+
+        columns = (width + tile_size - 1) // tile_size
+        rows = (height + tile_size - 1) // tile_size
+        tiles = columns * rows
+        bitmap = body[9:9 + (tiles + 7) // 8]
+        pos = 9 + len(bitmap)
+
+        for index in range(tiles):
+            if not bitmap[index >> 3] & (1 << (index & 7)):
+                continue
+            x = (index % columns) * tile_size
+            y = (index // columns) * tile_size
+            w = min(tile_size, width - x)
+            h = min(tile_size, height - y)
+            pixels, pos = self.decode_tile(body, pos, w * h)
+            for row in range(h):
+                start = (y + row) * width + x
+                self.pixels[start:start + w] = pixels[row * w:(row + 1) * w]
+
+        return frame_number
+
+    @staticmethod
+    def decode_tile(body, pos, count):
+        pixels = []
+        while len(pixels) < count:
+            control = body[pos]
+            pos += 1
+            if control & 0x80:
+                (pixel,) = struct.unpack_from("<H", body, pos)
+                pos += 2
+                pixels.extend([pixel] * ((control & 0x7F) + 1))
+            else:
+                length = control + 1
+                pixels.extend(struct.unpack_from("<%dH" % length, body, pos))
+                pos += length * 2
+        return pixels, pos
+
+    def rgb24(self):
+        out = bytearray(len(self.pixels) * 3)
+        for i, pixel in enumerate(self.pixels):
+            if self.swap:
+                pixel = ((pixel & 0xFF) << 8) | (pixel >> 8)
+            out[i * 3] = ((pixel >> 11) & 0x1F) << 3
+            out[i * 3 + 1] = ((pixel >> 5) & 0x3F) << 2
+            out[i * 3 + 2] = (pixel & 0x1F) << 3
+        return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", nargs="?", help="serial device or capture file (default: stdin)")
+    output = parser.add_mutually_exclusive_group(required=True)
+    output.add_argument("--out-dir", help="write each frame as frame_NNNNNN.ppm in this directory")
+    output.add_argument("--raw", action="store_true", help="write raw RGB24 frames to stdout")
+    parser.add_argument("--no-swap", action="store_true",
+                        help="pixels are native RGB565 (the display wants them byte swapped by default)")
+    args = parser.parse_args()
+
+    stream = open(args.source, "rb", buffering=0) if args.source else sys.stdin.buffer
+    if args.out_dir:
+        os.makedirs(args.out_dir, exist_ok=True)
+
+    framebuffer = Framebuffer(swap=not args.no_swap)
+    for body in frames(stream):
+        frame_number = framebuffer.apply(body)
+        image = framebuffer.rgb24()
+        if args.raw:
+            sys.stdout.buffer.write(image)
+            sys.stdout.buffer.flush()
+        else:
+            path = os.path.join(args.out_dir, "frame_%06d.ppm" % frame_number)
+            with open(path, "wb") as f:
+                f.write(b"P6 %d %d 255\n" % (framebuffer.width, framebuffer.height))
+                f.write(image)
+
+
+if __name__ == "__main__":
+    main()
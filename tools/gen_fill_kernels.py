@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""
+Generates the size-specialised drawing kernels used by src/sprite.c. Run by
+the build (see src/CMakeLists.txt); run it by hand to look at the output.
+
+    python3 tools/gen_fill_kernels.py src/sprite.c include/core.h build/sprite_kernels.h
+
+The player and every block size have a fixed shape, so rather than looping
+over a mask (or calling draw_rectangle) per pixel, each gets:
+
+    blit_<art>     stores the sprite's set pixels, fully unrolled
+    fill_<w>x<h>   fills its bounding box (the RENDER_BOXES backend), fully unrolled
+
+Both take the top left pixel, the framebuffer row stride and the colour. The
+sprites are read from the `*_art` arrays in sprite.c, and checked against the
+sizes in core.h.
+"""
+import argparse
+import re
+import sys
+
+PIXEL = "X"
+
+
+class KernelError(Exception):
+    pass
+
+
+def read_defines(source):
+    """The integer #defines in the source, resolving defines that name another."""
+    raw = dict(re.findall(r"^#define\s+(\w+)\s+(.+?)\s*(?://.*)?$", source, re.M))
+
+    def resolve(value, depth=0):
+        value = value.strip()
+        if re.fullmatch(r"-?\d+", value):
+            return int(value)
+        if value in raw and depth < 8:
+            return resolve(raw[value], depth + 1)
+        raise KernelError("can't resolve `%s` to a number" % value)
+
+    return raw, resolve
+
+
+def read_list(raw, resolve, name):
+    match = re.fullmatch(r"\{(.*)\}", raw.get(name, "").strip())
+    if not match:
+        raise KernelError("%s isn't a {...} list in core.h" % name)
+    return [resolve(item) for item in match.group(1).split(",")]
+
+
+def read_art(source):
+    """The pixel art arrays, and the art names of each block size in order."""
+    arts = {}
+    for name, body in re.findall(r"static const char\* const (\w+)_art\[[^\]]*\] = \{(.*?)\};", source, re.S):
+        arts[name] = re.findall(r'"([^"]*)"', body)
+
+    match = re.search(r"block_art\[[^\]]*\] = \{(.*?)\};", source, re.S)
+    if not match or "player" not in arts:
+        raise KernelError("sprite.c has no player_art or block_art")
+    blocks = [name.strip()[:-len("_art")] for name in match.group(1).split(",")]
+
+    for name in blocks:
+        if name not in arts:
+            raise KernelError("block_art names unknown art `%s_art`" % name)
+
+    return arts, blocks
+
+
+def check_size(name, art, width, height):
+    art_width = max(len(row) for row in art)
+    if len(art) != height or art_width > width:
+        raise KernelError("%s_art is %dx%d, but core.h says %dx%d" % (name, art_width, len(art), width, height))
+
+
+def blit_kernel(name, art):
+    lines = ["static void blit_%s(uint16_t* pixels, int stride, uint16_t colour) {" % name]
+    for r, row in enumerate(art):
+        stores = ["pixels[%d] = colour;" % c for c, pixel in enumerate(row) if pixel == PIXEL]
+        if stores:
+            lines.append("    " + " ".join(stores))
+        if r + 1 < len(art):
+            lines.append("    pixels += stride;")
+    lines.append("}")
+    return "\n".join(lines)
+
+
+def fill_kernel(width, height):
+    stores = " ".join("pixels[%d] = colour;" % c for c in range(width))
+    lines = ["static void fill_%dx%d(uint16_t* pixels, int stride, uint16_t colour) {" % (width, height)]
+    for r in range(height):
+        lines.append("    " + stores)
+        if r + 1 < height:
+            lines.append("    pixels += stride;")
+    lines.append("}")
+    return "\n".join(lines)
+
+
+def generate(sprite_source, core_source):
+    raw, resolve = read_defines(core_source)
+    widths = read_list(raw, resolve, "BLOCK_SIZE_WIDTHS")
+    heights = read_list(raw, resolve, "BLOCK_SIZE_HEIGHTS")
+    player = (resolve("PLAYER_WIDTH"), resolve("PLAYER_HEIGHT"))
+
+    arts, blocks = read_art(sprite_source)
+    if len(blocks) != len(widths) or len(widths) != len(heights):
+        raise KernelError("block_art has %d sizes, core.h has %d" % (len(blocks), len(widths)))
+
+    check_size("player", arts["player"], *player)
+    for name, width, height in zip(blocks, widths, heights):
+        check_size(name, arts[name], width, height)
+
+    sizes = []
+    for size in [player] + list(zip(widths, heights)):
+        if size not in sizes:
+            sizes.append(size)
+
+    out = [
+        "// Generated by tools/gen_fill_kernels.py from src/sprite.c and include/core.h; do not edit.",
+        "// Only included by sprite.c.",
+        "",
+    ]
+    out += [blit_kernel(name, arts[name]) + "\n" for name in ["player"] + list(dict.fromkeys(blocks))]
+    out += [fill_kernel(w, h) + "\n" for w, h in sizes]
+    out.append("static const SpriteKernel player_blit = blit_player;")
+    out.append("static const SpriteKernel player_fill = fill_%dx%d;" % player)
+    out.append("static const SpriteKernel block_blits[%d] = {%s};" % (len(blocks), ", ".join("blit_" + b for b in blocks)))
+    out.append("static const SpriteKernel block_fills[%d] = {%s};" % (
+        len(blocks), ", ".join("fill_%dx%d" % size for size in zip(widths, heights))))
+    return "\n".join(out) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("sprites", help="src/sprite.c")
+    parser.add_argument("core", help="include/core.h")
+    parser.add_argument("output", help="generated header")
+    args = parser.parse_args()
+
+    with open(args.sprites) as f:
+        sprite_source = f.read()
+    with open(args.core) as f:
+        core_source = f.read()
+
+    try:
+        header = generate(sprite_source, core_source)
+    except KernelError as e:
+        sys.exit("%s: %s" % (args.sprites, e))
+
+    with open(args.output, "w") as f:
+        f.write(header)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""
+Saves the overdraw heatmaps dumped to the console by the pixel write counters
+(src/pixelstats.c, built with -DPIXEL_STATS=ON) as greyscale PGM images.
+
+Reads a console log (serial device, capture file or stdin), picks out every
+HEATMAP BEGIN/DATA/END block and writes each as <prefix><n>.pgm. Each pixel
+is brighter the more times it was written in the frame; black was never
+written, and the --scale writes (default 4) or more is white.
+
+    python3 tools/heatmap.py console.log --prefix overdraw_
+"""
+import argparse
+import sys
+
+
+def heatmaps(lines):
+    """Yields (width, height, rows) for every dumped heatmap."""
+    current = None
+    for line in lines:
+        parts = line.strip().split()
+        if len(parts) < 2 or parts[0] != "HEATMAP":
+            continue
+        if parts[1] == "BEGIN" and len(parts) == 4:
+            current = (int(parts[2]), int(parts[3]), [])
+        elif parts[1] == "DATA" and current is not None and len(parts) == 3:
+            current[2].append(bytes.fromhex(parts[2]))
+        elif parts[1] == "END" and current is not None:
+            yield current
+            current = None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", nargs="?", help="console log (default: stdin)")
+    parser.add_argument("--prefix", default="heatmap_", help="output file prefix (default: heatmap_)")
+    parser.add_argument("--scale", type=int, default=4, help="writes per pixel shown as white (default: 4)")
+    args = parser.parse_args()
+
+    source = open(args.source, errors="replace") if args.source else sys.stdin
+    count = 0
+    for width, height, rows in heatmaps(source):
+        if len(rows) != height or any(len(row) != width for row in rows):
+            print("skipping incomplete heatmap #%d" % count, file=sys.stderr)
+            continue
+
+        pixels = bytearray()
+        writes = overdrawn = 0
+        for row in rows:
+            for heat in row:
+                pixels.append(min(255, heat * 255 // args.scale))
+                writes += heat
+                overdrawn += heat > 1
+
+        name = "%s%d.pgm" % (args.prefix, count)
+        with open(name, "wb") as out:
+            out.write(b"P5\n%d %d\n255\n" % (width, height))
+            out.write(pixels)
+
+        print("%s: %d writes (%.2fx the screen), %d pixels drawn more than once"
+              % (name, writes, writes / (width * height), overdrawn))
+        count += 1
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+Compiles spawn pattern source (patterns/*.pat) to the bytecode run by
+src/pattern.c. Run by the build (see src/CMakeLists.txt); run it by hand to
+check a pattern file, or with --list to see how large each pattern compiles to.
+
+    python3 tools/patternc.py patterns/waves.pat build/patterns.bin --list
+
+Source is one instruction per line, `#` starts a comment. Each pattern starts
+with `pattern <name>` and runs until `end`; patterns are listed easiest first.
+
+    wait <ms>                            spawn nothing more for <ms> ms
+    spawn <x|random> <size> <speed>      spawn a block
+    wall <gap_x> <gap_width> <size> <speed>
+    set_x <x|random>
+    move_x <dx>
+    spawn_at <size> <speed>              spawn a block at the x register
+    repeat <count> ... loop
+
+Sizes index BLOCK_SIZE_WIDTHS/HEIGHTS and speeds index BLOCK_SPEED_QUARTERS in
+include/core.h.
+"""
+import argparse
+import struct
+import sys
+
+FORMAT_VERSION = 1
+RANDOM_X = 255
+
+# Must match core.h
+BLOCK_SIZE_COUNT = 4
+BLOCK_SPEED_COUNT = 3
+PATTERN_MAX_DEPTH = 4
+
+# name: (opcode, operand kinds); "u8" byte, "s8" signed byte, "u16" little endian
+# word, "x" byte or `random`, "size"/"speed" bytes checked against the tables
+INSTRUCTIONS = {
+    "end": (0, []),
+    "wait": (1, ["u16"]),
+    "spawn": (2, ["x", "size", "speed"]),
+    "wall": (3, ["u8", "u8", "size", "speed"]),
+    "set_x": (4, ["x"]),
+    "move_x": (5, ["s8"]),
+    "spawn_at": (6, ["size", "speed"]),
+    "repeat": (7, ["count"]),
+    "loop": (8, []),
+}
+
+
+class CompileError(Exception):
+    pass
+
+
+def operand(kind, text):
+    if kind == "x" and text == "random":
+        return struct.pack("<B", RANDOM_X)
+
+    try:
+        value = int(text, 0)
+    except ValueError:
+        raise CompileError("expected a number, got '%s'" % text)
+
+    limits = {
+        "u8": (0, 255), "x": (0, RANDOM_X - 1), "s8": (-128, 127), "u16": (0, 65535),
+        "size": (0, BLOCK_SIZE_COUNT - 1), "speed": (0, BLOCK_SPEED_COUNT - 1), "count": (1, 255),
+    }
+    low, high = limits[kind]
+    if not low <= value <= high:
+        raise CompileError("%s %d out of range %d..%d" % (kind, value, low, high))
+
+    return struct.pack("<H" if kind == "u16" else "<b" if kind == "s8" else "<B", value)
+
+
+def compile_source(lines):
+    """Returns [(name, bytecode)] for every pattern in the source."""
+    patterns = []
+    current = None
+    depth = 0
+    for number, line in enumerate(lines, 1):
+        words = line.split("#", 1)[0].split()
+        if not words:
+            continue
+
+        try:
+            if words[0] == "pattern":
+                if current is not None:
+                    raise CompileError("pattern '%s' has no end" % current[0])
+                if len(words) != 2:
+                    raise CompileError("expected: pattern <name>")
+                current = (words[1], bytearray())
+                continue
+
+            if current is None:
+                raise CompileError("instruction outside a pattern")
+            if words[0] not in INSTRUCTIONS:
+                raise CompileError("unknown instruction '%s'" % words[0])
+
+            opcode, kinds = INSTRUCTIONS[words[0]]
+            if len(words) - 1 != len(kinds):
+                raise CompileError("%s takes %d operands" % (words[0], len(kinds)))
+
+            if words[0] == "repeat":
+                depth += 1
+                if depth > PATTERN_MAX_DEPTH:
+                    raise CompileError("repeats nested more than %d deep" % PATTERN_MAX_DEPTH)
+            elif words[0] == "loop":
+                if depth == 0:
+                    raise CompileError("loop without repeat")
+                depth -= 1
+
+            current[1].append(opcode)
+            for kind, text in zip(kinds, words[1:]):
+                current[1].extend(operand(kind, text))
+
+            if words[0] == "end":
+                if depth:
+                    raise CompileError("repeat without loop")
+                patterns.append(current)
+                current = None
+        except CompileError as e:
+            raise CompileError("line %d: %s" % (number, e))
+
+    if current is not None:
+        raise CompileError("pattern '%s' has no end" % current[0])
+    if not 0 < len(patterns) < 256:
+        raise CompileError("expected 1 to 255 patterns, found %d" % len(patterns))
+
+    return patterns
+
+
+def link(patterns):
+    header = struct.pack("<3sBB", b"FBP", FORMAT_VERSION, len(patterns))
+    offset = len(header) + 2 * len(patterns)
+
+    table = b""
+    body = b""
+    for _, code in patterns:
+        table += struct.pack("<H", offset + len(body))
+        body += code
+
+    if offset + len(body) > 0xFFFF:
+        raise CompileError("compiled patterns are larger than 64KB")
+
+    return header + table + body
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", help="pattern source file")
+    parser.add_argument("output", help="compiled pattern file")
+    parser.add_argument("--list", action="store_true", help="print the size of each compiled pattern")
+    args = parser.parse_args()
+
+    try:
+        with open(args.source) as f:
+            patterns = compile_source(f)
+        data = link(patterns)
+    except CompileError as e:
+        sys.exit("%s: %s" % (args.source, e))
+
+    with open(args.output, "wb") as f:
+        f.write(data)
+
+    if args.list:
+        for i, (name, code) in enumerate(patterns):
+            print("%2d %-16s %4d bytes" % (i, name, len(code)))
+        print("total %d bytes" % len(data))
+
+
+if __name__ == "__main__":
+    main()
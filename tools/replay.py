@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""
+Decodes game recordings dumped to the console by replayDump() (src/replay.c).
+
+Reads a console log (serial device, capture file or stdin), picks out every
+REPLAY BEGIN/DATA/END block and prints the recorded events of each game, or a
+one line summary per game with --summary.
+
+    python3 tools/replay.py console.log --summary
+"""
+import argparse
+import sys
+
+TARGET_FPS = 30
+NOMINAL_DT = 1000000 // TARGET_FPS
+DIRECTIONS = ["LEFT", "RIGHT", "NONE"]
+TAGS = ["TICK", "INPUT", "START", "END"]
+
+# Input values from here on are block limits set from the console (INPUT_BLOCK_LIMIT in src/replay.c)
+INPUT_BLOCK_LIMIT = 8
+
+
+def varints(data):
+    value = 0
+    shift = 0
+    for byte in data:
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            yield value
+            value = 0
+            shift = 0
+
+
+def events(data):
+    """Yields (tag, value) for every event in a recording."""
+    for raw in varints(data):
+        tag = TAGS[raw & 0x3]
+        value = raw >> 2
+        if tag == "TICK":
+            value = NOMINAL_DT + ((value >> 1) ^ -(value & 1))
+        elif tag == "INPUT" and value >= INPUT_BLOCK_LIMIT:
+            tag = "LIMIT"
+            value -= INPUT_BLOCK_LIMIT
+        yield tag, value
+
+
+def recordings(lines):
+    """Yields (game_id, score, bytes) for every dumped recording."""
+    current = None
+    for line in lines:
+        parts = line.strip().split()
+        if len(parts) < 3 or parts[0] != "REPLAY":
+            continue
+        if parts[1] == "BEGIN":
+            current = (int(parts[2]), int(parts[4]), bytearray())
+        elif parts[1] == "DATA" and current is not None:
+            current[2].extend(bytes.fromhex(parts[2]))
+        elif parts[1] == "END" and current is not None:
+            yield current
+            current = None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", nargs="?", help="console log (default: stdin)")
+    parser.add_argument("--summary", action="store_true", help="print one line per game")
+    args = parser.parse_args()
+
+    source = open(args.source, errors="replace") if args.source else sys.stdin
+    for game_id, score, data in recordings(source):
+        ticks = inputs = 0
+        game_time = 0
+        seed = None
+        for tag, value in events(data):
+            if tag == "TICK":
+                ticks += 1
+                game_time += value
+            elif tag == "INPUT":
+                inputs += 1
+            elif tag == "START":
+                seed = value
+
+            if not args.summary:
+                shown = DIRECTIONS[value] if tag == "INPUT" and value < len(DIRECTIONS) else value
+                print("game %d  tick %6d  %-5s %s" % (game_id, ticks, tag, shown))
+
+        print("game %d: seed %s, %d ticks (%.1fs), %d inputs, score %d, %d bytes" % (
+            game_id, seed, ticks, game_time / 1e6, inputs, score, len(data)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,228 @@
+#!/usr/bin/env python3
+"""
+Host side decoder for the spectator stream written by src/spectator.c.
+
+Reads the raw serial stream (from a serial device, a capture file or stdin),
+rebuilds the game state from the keyframes and deltas, and renders it in the
+terminal. Any bytes that aren't part of a valid frame (console output from the
+game, line noise) are skipped.
+
+Usage:
+    stty -F /dev/ttyUSB0 115200 raw && python3 tools/spectator.py /dev/ttyUSB0
+    python3 tools/spectator.py capture.bin --no-render
+"""
+import argparse
+import sys
+
+SYNC = b"\xa5\x5a"
+
+# Must match core.h / game.h
+DISPLAY_WIDTH = 135
+DISPLAY_HEIGHT = 240
+PLAYER_WIDTH = 20
+PLAYER_HEIGHT = 20
+PHASES = ["MENU", "DEATH", "GAME"]
+
+# Size of a terminal cell in game pixels
+CELL_W = 3
+CELL_H = 6
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+class BitReader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def bits(self, count):
+        value = 0
+        for i in range(count):
+            byte = self.data[self.pos >> 3]
+            if byte & (1 << (self.pos & 7)):
+                value |= 1 << i
+            self.pos += 1
+        return value
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            group = self.bits(4)
+            value |= (group & 0x7) << shift
+            shift += 3
+            if not group & 0x8:
+                return value
+
+    def svarint(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+
+class Game:
+    def __init__(self):
+        self.synced = False
+        self.tick = 0
+        self.phase = 0
+        self.block_count = 0
+        self.player_x = 0
+        self.player_y = 0
+        self.score = 0
+        self.velocity = 0
+        self.visible = 0
+        self.blocks_x = []
+        self.blocks_y = []
+        self.blocks_w = []
+        self.blocks_h = []
+
+    def apply(self, payload):
+        r = BitReader(payload)
+        if r.bits(1):
+            self.keyframe(r)
+        elif self.synced:
+            self.delta(r)
+
+    def keyframe(self, r):
+        self.tick = r.varint()
+        self.phase = r.bits(2)
+        self.block_count = r.varint()
+        self.player_x = r.varint()
+        self.player_y = r.varint()
+        self.score = r.varint()
+        self.velocity = r.varint()
+        self.visible = r.bits(self.block_count)
+        self.blocks_x = [0] * self.block_count
+        self.blocks_y = [0] * self.block_count
+        self.blocks_w = [0] * self.block_count
+        self.blocks_h = [0] * self.block_count
+        for i in self.indices(self.visible):
+            self.read_block(r, i)
+        self.synced = True
+
+    def delta(self, r):
+        self.tick += r.varint() + 1
+        if r.bits(1):
+            self.phase = r.bits(2)
+        if r.bits(1):
+            self.player_x += r.svarint()
+        if r.bits(1):
+            self.score += r.svarint()
+        if r.bits(1):
+            self.velocity += r.svarint()
+        if not r.bits(1):
+            return
+
+        previous = self.visible
+        self.visible ^= r.bits(self.block_count)
+        persisting = self.visible & previous
+        for i in self.indices(self.visible & ~previous):
+            self.read_block(r, i)
+
+        if not persisting:
+            return
+
+        common_dy = r.svarint()
+        exceptions = r.bits(1)
+        x_moved = r.bits(1)
+        for i in self.indices(persisting):
+            dy = common_dy
+            if exceptions and r.bits(1):
+                dy = r.svarint()
+            self.blocks_y[i] += dy
+            if x_moved and r.bits(1):
+                self.blocks_x[i] += r.svarint()
+
+    def read_block(self, r, i):
+        self.blocks_x[i] = r.varint()
+        self.blocks_y[i] = r.svarint()
+        self.blocks_w[i] = r.varint()
+        self.blocks_h[i] = r.varint()
+
+    def indices(self, mask):
+        return [i for i in range(self.block_count) if mask & (1 << i)]
+
+    def render(self):
+        cols = DISPLAY_WIDTH // CELL_W
+        rows = DISPLAY_HEIGHT // CELL_H
+        grid = [[" "] * cols for _ in range(rows)]
+
+        def fill(x, y, w, h, ch):
+            for row in range(max(0, y // CELL_H), min(rows, (y + h) // CELL_H + 1)):
+                for col in range(max(0, x // CELL_W), min(cols, (x + w) // CELL_W + 1)):
+                    grid[row][col] = ch
+
+        if PHASES[self.phase] == "GAME":
+            for i in self.indices(self.visible):
+                fill(self.blocks_x[i], self.blocks_y[i], self.blocks_w[i], self.blocks_h[i], "#")
+            fill(self.player_x, self.player_y, PLAYER_WIDTH, PLAYER_HEIGHT, "@")
+
+        out = ["\x1b[H\x1b[2J"]
+        out.append("tick %d  %s  score %d  velocity %d\n" % (self.tick, PHASES[self.phase], self.score, self.velocity))
+        out.append("+" + "-" * cols + "+\n")
+        out.extend("|" + "".join(row) + "|\n" for row in grid)
+        out.append("+" + "-" * cols + "+\n")
+        sys.stdout.write("".join(out))
+        sys.stdout.flush()
+
+
+def frames(stream):
+    """Yields the payload of every valid frame in the byte stream."""
+    buffer = bytearray()
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            return
+        buffer += chunk
+        while True:
+            start = buffer.find(SYNC)
+            if start < 0:
+                del buffer[:-1]
+                break
+            if len(buffer) < start + 4:
+                del buffer[:start]
+                break
+            length = buffer[start + 2] | (buffer[start + 3] << 8)
+            end = start + 4 + length + 1
+            if len(buffer) < end:
+                del buffer[:start]
+                break
+            payload = bytes(buffer[start + 4:end - 1])
+            if crc8(payload) == buffer[end - 1]:
+                yield payload
+                del buffer[:end]
+            else:
+                # Not a real frame; resync on the next sync marker
+                del buffer[:start + 1]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", nargs="?", help="serial device or capture file (default: stdin)")
+    parser.add_argument("--no-render", action="store_true", help="print one summary line per frame instead")
+    args = parser.parse_args()
+
+    stream = open(args.source, "rb", buffering=0) if args.source else sys.stdin.buffer
+    game = Game()
+    received = 0
+    for payload in frames(stream):
+        received += len(payload) + 5
+        game.apply(payload)
+        if not game.synced:
+            continue
+        if args.no_render:
+            print("tick %d %s score=%d x=%d blocks=%d bytes=%d" % (
+                game.tick, PHASES[game.phase], game.score, game.player_x,
+                bin(game.visible).count("1"), received))
+        else:
+            game.render()
+
+
+if __name__ == "__main__":
+    main()
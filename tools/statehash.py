@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""
+Compares the per-tick state hashes printed by src/statehash.c (built with
+STATE_HASH_ENABLED 1), and reports the first tick (and part of the state) at
+which two runs of the same seed and inputs diverge.
+
+With one console log, each re-run of a recording (`replay verify <n>` in the
+console) is compared with the original game of the same seed. With two logs,
+the games of the first are compared with the games of the same seed in the
+second; say, the same recording re-run on two different builds.
+
+    python3 tools/statehash.py console.log
+    python3 tools/statehash.py before.log after.log
+
+Exits with 1 if any pair of runs diverged.
+"""
+import argparse
+import sys
+
+FIELDS = ["player", "score", "velocity", "rng", "blocks"]
+
+
+class Run:
+    def __init__(self, seed, source):
+        self.seed = seed
+        self.source = source
+        self.ticks = []
+        self.end = None
+
+
+def runs(lines):
+    """Yields a Run for every game in the log, complete or not."""
+    current = None
+    for line in lines:
+        parts = line.strip().split()
+        if len(parts) < 2 or parts[0] != "STATE":
+            continue
+        if parts[1] == "BEGIN" and len(parts) == 4:
+            if current is not None:
+                yield current
+            current = Run(parts[2], parts[3])
+        elif parts[1] == "END" and current is not None and len(parts) == 4:
+            current.end = (int(parts[2], 16), int(parts[3]))
+            yield current
+            current = None
+        elif current is not None and len(parts) == 2 + len(FIELDS):
+            tick = int(parts[1], 16)
+            # A tick missing from the log (dropped serial bytes) is kept as unknown
+            while len(current.ticks) < tick - 1:
+                current.ticks.append(None)
+            current.ticks.append(parts[2:])
+    if current is not None:
+        yield current
+
+
+def compare(a, b):
+    """Describes where two runs first differ, or None if they match."""
+    for tick, (x, y) in enumerate(zip(a.ticks, b.ticks), 1):
+        if x is None or y is None:
+            continue
+        for field, p, q in zip(FIELDS, x, y):
+            if p != q:
+                return "diverged at tick %d in %s (%s vs %s)" % (tick, field, p, q)
+
+    if len(a.ticks) != len(b.ticks):
+        shorter = a if len(a.ticks) < len(b.ticks) else b
+        return "diverged at tick %d: the %s run ended" % (len(shorter.ticks) + 1, shorter.source)
+    if a.end and b.end and a.end[1] != b.end[1]:
+        return "diverged at the end: score %d vs %d" % (a.end[1], b.end[1])
+    return None
+
+
+def pairs(first, second):
+    """The runs to compare; re-runs against originals, or games across two logs."""
+    if second is None:
+        originals = {}
+        for run in first:
+            if run.source == "live":
+                originals[run.seed] = run
+            elif run.seed in originals:
+                yield originals[run.seed], run
+            else:
+                print("seed %s: re-run, but the original isn't in the log" % run.seed, file=sys.stderr)
+        return
+
+    others = {}
+    for run in second:
+        others.setdefault((run.seed, run.source), run)
+    for run in first:
+        if (run.seed, run.source) in others:
+            yield run, others[(run.seed, run.source)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("first", help="console log")
+    parser.add_argument("second", nargs="?", help="console log to compare against")
+    args = parser.parse_args()
+
+    with open(args.first, errors="replace") as f:
+        first = list(runs(f))
+    second = None
+    if args.second:
+        with open(args.second, errors="replace") as f:
+            second = list(runs(f))
+
+    compared = diverged = 0
+    for a, b in pairs(first, second):
+        compared += 1
+        problem = compare(a, b)
+        if problem:
+            diverged += 1
+            print("seed %s: %s" % (a.seed, problem))
+        else:
+            print("seed %s: identical over %d ticks" % (a.seed, len(a.ticks)))
+
+    if compared == 0:
+        sys.exit("no runs of the same seed to compare")
+    sys.exit(1 if diverged else 0)
+
+
+if __name__ == "__main__":
+    main()